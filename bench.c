@@ -0,0 +1,147 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* Startup benchmark. Runs a command over and over and reports how long it
+ * took from exec to the first byte on its standard output, and to its exit,
+ * which is what a user waiting on a page sees. Standard error is dropped. */
+
+/* Includes */
+#include <err.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+/* Constants and Macros */
+#define DEFAULT_RUNS 200
+#define WARMUP_RUNS 5 /* Fill the page cache before measuring. */
+
+/* Function prototypes */
+static long long now_us(void);
+static int run_once(char *const argv[], long long *first, long long *done);
+static int ll_cmp(const void *a, const void *b);
+static void report(const char *label, long long *us, size_t n);
+
+long long
+now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int
+run_once(char *const argv[], long long *first, long long *done)
+{
+	char buf[4096];
+	long long start;
+	ssize_t n;
+	pid_t pid;
+	int fds[2], null, status;
+
+	if (pipe(fds) == -1)
+		err(1, "pipe");
+	start = now_us();
+	if ((pid = fork()) == -1)
+		err(1, "fork");
+	if (pid == 0) {
+		if ((null = open("/dev/null", O_WRONLY)) == -1 ||
+		    dup2(fds[1], STDOUT_FILENO) == -1 ||
+		    dup2(null, STDERR_FILENO) == -1)
+			_exit(127);
+		close(fds[0]);
+		close(fds[1]);
+		close(null);
+		execvp(argv[0], argv);
+		_exit(127);
+	}
+	close(fds[1]);
+
+	*first = -1;
+	while ((n = read(fds[0], buf, sizeof(buf))) != 0) {
+		if (n == -1)
+			err(1, "read");
+		if (*first == -1)
+			*first = now_us() - start;
+	}
+	close(fds[0]);
+	if (waitpid(pid, &status, 0) == -1)
+		err(1, "waitpid");
+	*done = now_us() - start;
+
+	if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		warnx("%s failed", argv[0]);
+		return -1;
+	}
+	if (*first == -1) {
+		warnx("%s wrote nothing", argv[0]);
+		return -1;
+	}
+	return 0;
+}
+
+int
+ll_cmp(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+void
+report(const char *label, long long *us, size_t n)
+{
+	qsort(us, n, sizeof(*us), ll_cmp);
+	printf("%-10s  min %6lldus  p50 %6lldus  p90 %6lldus  p99 %6lldus  "
+	       "max %6lldus\n", label, us[0], us[n / 2], us[n * 9 / 10],
+	       us[n * 99 / 100], us[n - 1]);
+}
+
+int
+main(int argc, char *argv[])
+{
+	long long *first, *done, f, d;
+	size_t runs = DEFAULT_RUNS, i;
+	char *end;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "+n:")) != -1) {
+		switch (opt) {
+		case 'n':
+			runs = strtoul(optarg, &end, 10);
+			if (*optarg == 0 || *end != 0 || runs == 0)
+				errx(1, "invalid run count %s", optarg);
+			break;
+		default:
+			goto usage;
+		}
+	}
+	if (optind >= argc)
+		goto usage;
+	argv += optind;
+
+	if ((first = malloc(runs * sizeof(*first))) == NULL ||
+	    (done = malloc(runs * sizeof(*done))) == NULL)
+		err(1, "malloc");
+	for (i = 0; i < WARMUP_RUNS; i++)
+		if (run_once(argv, &f, &d) == -1)
+			return 1;
+	for (i = 0; i < runs; i++)
+		if (run_once(argv, &first[i], &done[i]) == -1)
+			return 1;
+
+	printf("%zu runs of %s\n", runs, argv[0]);
+	report("first byte", first, runs);
+	report("exit", done, runs);
+	free(first);
+	free(done);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: tldr-bench [-n RUNS] COMMAND [ARG]...\n");
+	return 1;
+}
@@ -2,16 +2,52 @@
 
 /* URL to download the archive with man pages. */
 static const char *PAGES_URL = "https://github.com/tldr-pages/tldr/releases/download/v2.3/tldr-pages.en.zip";
-/* Path to store man pages. */
-static const char *PAGES_HOME = "~/.local/share/tinytldr/pages";
+/* Mirrors of PAGES_URL, e.g. a LAN cache or "file:///srv/tldr-pages.en.zip";
+ * the fastest so far are raced and PAGES_URL is the last resort. */
+static const char *PAGES_MIRRORS[] = { NULL };
+/* Expected SHA-256 of the archive; NULL to rely on SUMS_URL. */
+static const char *PAGES_SHA256 = NULL;
+/* Published sha256sums for the archive; updates fail if it cannot be read or
+ * does not list the archive. NULL, with PAGES_SHA256, to skip verification. */
+static const char *SUMS_URL = "https://github.com/tldr-pages/tldr/releases/download/v2.3/tldr.sha256sums";
+/* Fetch only changed pages with HTTP range requests when possible? The
+ * pieces cannot be checked against an archive digest, so this only takes
+ * effect with PAGES_SHA256 and SUMS_URL both NULL. */
+static const int DELTA_UPDATE = 0;
+/* Download rate cap in bytes per second; 0 for no limit. */
+static const long MAX_RATE = 0;
+/* Abort downloads slower than LOW_SPEED_LIMIT bytes per second for
+ * LOW_SPEED_TIME seconds; 0 to wait forever. A rate cap at or below the
+ * limit lowers it to half the cap. */
+static const long LOW_SPEED_LIMIT = 1024;
+static const long LOW_SPEED_TIME = 30;
+/* Give up on an update after this many seconds; 0 for never. */
+static const long UPDATE_TIMEOUT = 0;
+/* Retry failed updates this many times, backing off exponentially. */
+static const int UPDATE_RETRIES = 2;
+/* Wait a random time of up to this many seconds before updating, so that
+ * hosts updating from cron do not all start at once. */
+static const long START_JITTER = 0;
+/* Log the pages you read next to PAGES_HOME, so that updates store the most
+ * used ones together and --warm knows what to prefetch? */
+static const int TRACK_USAGE = 0;
+/* Refresh pages in the background once they are older than this many
+ * seconds, e.g. 30L * 24 * 60 * 60 for monthly; 0 to only update on
+ * --update, so that showing a page never touches the network. */
+static const long AUTO_UPDATE_AGE = 0;
+/* Path to store man pages; a leading ~/ is $HOME. NULL for
+ * $XDG_DATA_HOME/tinytldr/pages, or ~/.local/share/tinytldr/pages. */
+static const char *PAGES_HOME = NULL;
 
 /* Print empty lines from pages? */
 static const int SKIP_EMPTY = 1;
 /* Apply ANSI styling to pages? */
 static const int APPLY_STYLES = 1;
 /* Page styling; see https://en.wikipedia.org/wiki/ANSI_escape_code */
-static const char *HEADING_STYLE = "\033[31m";
-static const char *SUMMARY_STYLE = "\033[22;4m";
-static const char *COMMENT_STYLE = "\033[22;32m";
-static const char *COMMAND_STYLE = "\033[1m";
-static const char *RESET_STYLE   = "\033[0m\033[0K";
+static const char *HEADING_STYLE     = "\033[31m";
+static const char *SUMMARY_STYLE     = "\033[22;4m";
+static const char *COMMENT_STYLE     = "\033[22;32m";
+static const char *COMMAND_STYLE     = "\033[1m";
+static const char *CODE_STYLE        = "\033[1m";
+static const char *PLACEHOLDER_STYLE = "\033[22;4m";
+static const char *RESET_STYLE       = "\033[0m\033[0K";
@@ -0,0 +1,15 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* Includes */
+#include <string.h>
+
+#include "cost.h"
+
+Cost cost;
+
+void
+cost_reset(void)
+{
+	memset(&cost, 0, sizeof(cost));
+}
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+#ifndef COST_H
+#define COST_H
+
+/* Work done since the last cost_reset(), so tests can bound what a lookup
+ * or a render costs rather than time it. Counts are relaxed atomic adds,
+ * cheap enough to leave in. */
+typedef struct {
+	unsigned long dirents;    /* Directory entries read, "." and ".." aside. */
+	unsigned long opens;      /* Files and directories opened. */
+	unsigned long stats;      /* Paths stat()ed; fstat() of an open file aside. */
+	unsigned long long bytes; /* Read from files; a mapping is not a read. */
+	unsigned long probes;     /* Index entries looked at, for the mapping. */
+	unsigned long writes;     /* write(2) calls; stdio streams aside. */
+} Cost;
+
+extern Cost cost;
+
+#define COST_ADD(field, n) \
+	((void)__atomic_fetch_add(&cost.field, (n), __ATOMIC_RELAXED))
+
+/* Zero every counter. */
+void cost_reset(void);
+
+#endif /* COST_H */
@@ -0,0 +1,58 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* Includes */
+#include <stdlib.h>
+#include <string.h>
+
+#include <zlib.h>
+
+#include "embed.h"
+
+/* Function prototypes */
+static const EmbedPage *lookup(const EmbedTable *t, const char *name,
+                               const char *platform);
+
+const EmbedPage *
+lookup(const EmbedTable *t, const char *name, const char *platform)
+{
+	const EmbedPage *page;
+	uint32_t seed;
+
+	if (t->nslots == 0)
+		return NULL;
+
+	/* Two hashes find the only page the key can be; then confirm it. */
+	seed = t->seeds[embed_hash(0, platform, name) % t->nseeds];
+	page = &embed_pages[t->slots[embed_hash(seed, platform, name) % t->nslots]];
+	if (strcmp(page->name, name) != 0)
+		return NULL;
+	if (platform != NULL && strcmp(page->platform, platform) != 0)
+		return NULL;
+	return page;
+}
+
+const EmbedPage *
+embed_find(const char *name, const char *platform)
+{
+	if (platform == NULL)
+		return lookup(&embed_by_name, name, NULL);
+	return lookup(&embed_by_path, name, platform);
+}
+
+char *
+embed_read(const EmbedPage *page, size_t *len)
+{
+	uLongf n = page->raw_size;
+	char *buf;
+
+	if ((buf = malloc(n + 1)) == NULL)
+		return NULL;
+	if (uncompress((Bytef *)buf, &n, embed_data + page->offset,
+	               page->size) != Z_OK || n != page->raw_size) {
+		free(buf);
+		return NULL;
+	}
+	*len = n;
+	return buf;
+}
@@ -0,0 +1,62 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+#ifndef EMBED_H
+#define EMBED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	const char *name;     /* File name, such as "tar.md". */
+	const char *platform; /* Directory it was in, such as "common". */
+	uint32_t offset;      /* Deflated body within embed_data. */
+	uint32_t size;
+	uint32_t raw_size;    /* Length of the page itself. */
+} EmbedPage;
+
+/* A minimal perfect hash: a key lands in bucket hash(0) % nseeds, whose
+ * seed picks its slot as hash(seed) % nslots; a slot holds a page index. */
+typedef struct {
+	const uint32_t *seeds;
+	uint32_t nseeds;
+	const uint32_t *slots;
+	uint32_t nslots;
+} EmbedTable;
+
+/* Generated by embedgen from a pages archive. Pages are sorted like
+ * list_pages() sorts files on disk. */
+extern const unsigned char embed_data[];
+extern const EmbedPage embed_pages[];
+extern const size_t embed_npages;
+/* Keyed by platform and name; every page. */
+extern const EmbedTable embed_by_path;
+/* Keyed by name alone; the first page of each name. */
+extern const EmbedTable embed_by_name;
+
+/* Hash "<platform>/<name>", or just name if platform is NULL. Shared by
+ * embedgen and the lookup, so both must agree on it. */
+static inline uint32_t
+embed_hash(uint32_t seed, const char *platform, const char *name)
+{
+	uint64_t h = 0xcbf29ce484222325ULL ^ ((uint64_t)seed * 0x9e3779b97f4a7c15ULL);
+
+	if (platform != NULL) {
+		for (; *platform; platform++)
+			h = (h ^ (unsigned char)*platform) * 0x100000001b3ULL;
+		h = (h ^ '/') * 0x100000001b3ULL;
+	}
+	for (; *name; name++)
+		h = (h ^ (unsigned char)*name) * 0x100000001b3ULL;
+	/* FNV alone mixes the high bits poorly; finish like MurmurHash3. */
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return (uint32_t)h;
+}
+
+/* Find the page called name on platform (any platform if NULL). */
+const EmbedPage *embed_find(const char *name, const char *platform);
+/* Inflate the page into a new buffer; the caller must free it. */
+char *embed_read(const EmbedPage *page, size_t *len);
+
+#endif /* EMBED_H */
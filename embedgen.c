@@ -0,0 +1,439 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* Build-time generator for the embedded pages. Reads a pages archive and
+ * writes C source with every page deflated, in the order list_pages() would
+ * show them, and two minimal perfect hashes (hash and displace) that find a
+ * page by platform and name, or by name alone. Given a usage log, the
+ * bodies of the most used pages go first and together. See embed.h. */
+
+/* Includes */
+#include <err.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+#include <zlib.h>
+
+#include "embed.h"
+#include "usage.h"
+#include "walk.h"
+
+/* Constants and Macros */
+#define PAGE_EXT ".md"
+#define BUCKET_KEYS 4       /* Average keys per bucket; fewer buckets, fewer seeds. */
+#define MAX_SEED 0x1000000  /* Give up on a bucket after this many seeds. */
+#define EMPTY UINT32_MAX    /* A slot no key landed in yet. */
+#define BYTES_PER_LINE 16
+
+/* Typedefs */
+typedef struct {
+	char *path;           /* Within the archive. */
+	char *dir;            /* Copy of path, cut at the last slash. */
+	const char *platform;
+	const char *name;
+	unsigned char *data;  /* Deflated. */
+	uLong size;
+	uLong raw_size;
+	size_t order;         /* Position in the archive. */
+	size_t rank;          /* Position in the usage log; SIZE_MAX if absent. */
+	uint64_t offset;      /* Within embed_data. */
+} Page;
+
+typedef struct {
+	const char *platform; /* NULL to key by name alone. */
+	const char *name;
+	uint32_t value;       /* Page index. */
+} Key;
+
+typedef struct {
+	uint32_t bucket;
+	uint32_t key;
+} Member;
+
+typedef struct {
+	uint32_t bucket;
+	uint32_t start;       /* First member. */
+	uint32_t len;
+} Bucket;
+
+/* Function prototypes */
+static size_t read_pages(const char *file, Page **pages);
+static int page_cmp(const void *a, const void *b);
+static int path_cmp(const void *a, const void *b);
+static int rank_cmp(const void *a, const void *b);
+static int name_cmp(const void *a, const void *b);
+static int member_cmp(const void *a, const void *b);
+static int bucket_cmp(const void *a, const void *b);
+static int place(const Key *keys, uint32_t n, uint32_t nseeds,
+                 uint32_t *seeds, uint32_t *slots);
+static void build_table(const char *name, const Key *keys, uint32_t n);
+static void emit_string(const char *s);
+static void emit_u32s(const char *name, const uint32_t *v, uint32_t n);
+
+size_t
+read_pages(const char *file, Page **pages)
+{
+	struct archive *a;
+	struct archive_entry *entry;
+	const char *path;
+	unsigned char *raw = NULL, *tmp;
+	size_t n = 0, cap = 0, raw_cap = 0, len;
+	ssize_t got;
+	char *slash;
+	Page *p;
+	int r;
+
+	if ((a = archive_read_new()) == NULL)
+		errx(1, "archive_read_new failed");
+	archive_read_support_filter_all(a);
+	archive_read_support_format_all(a);
+	if (archive_read_open_filename(a, file, 65536) != ARCHIVE_OK)
+		errx(1, "%s: %s", file, archive_error_string(a));
+
+	*pages = NULL;
+	while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+		if (archive_entry_filetype(entry) != AE_IFREG)
+			continue;
+		if ((path = archive_entry_pathname(entry)) == NULL)
+			continue;
+		while (strncmp(path, "./", 2) == 0)
+			path += 2;
+		/* Only pages inside a platform directory. */
+		len = strlen(path);
+		if (strchr(path, '/') == NULL || len <= strlen(PAGE_EXT) ||
+		    strcmp(path + len - strlen(PAGE_EXT), PAGE_EXT) != 0)
+			continue;
+
+		for (len = 0;;) {
+			if (len == raw_cap) {
+				raw_cap = raw_cap ? raw_cap * 2 : 65536;
+				if ((tmp = realloc(raw, raw_cap)) == NULL)
+					err(1, "realloc");
+				raw = tmp;
+			}
+			got = archive_read_data(a, raw + len, raw_cap - len);
+			if (got < 0)
+				errx(1, "%s: %s", path, archive_error_string(a));
+			if (got == 0)
+				break;
+			len += (size_t)got;
+		}
+
+		if (n == cap) {
+			cap = cap ? cap * 2 : 1024;
+			if ((p = realloc(*pages, cap * sizeof(**pages))) == NULL)
+				err(1, "realloc");
+			*pages = p;
+		}
+		p = &(*pages)[n];
+		if ((p->path = strdup(path)) == NULL || (p->dir = strdup(path)) == NULL)
+			err(1, "strdup");
+		slash = strrchr(p->dir, '/');
+		*slash = 0;
+		p->name = slash + 1;
+		p->platform = (slash = strrchr(p->dir, '/')) != NULL ? slash + 1 : p->dir;
+		p->raw_size = len;
+		p->size = compressBound(len);
+		if ((p->data = malloc(p->size)) == NULL)
+			err(1, "malloc");
+		if (compress2(p->data, &p->size, raw, len, Z_BEST_COMPRESSION) != Z_OK)
+			errx(1, "%s: unable to compress", path);
+		p->order = n++;
+		p->rank = SIZE_MAX;
+	}
+	if (r != ARCHIVE_EOF)
+		errx(1, "%s: %s", file, archive_error_string(a));
+
+	free(raw);
+	archive_read_free(a);
+	return n;
+}
+
+int
+page_cmp(const void *a, const void *b)
+{
+	const Page *pa = a, *pb = b;
+	int c;
+
+	if ((c = walk_pathcmp(pa->path, pb->path)) != 0)
+		return c;
+	return (pa->order > pb->order) - (pa->order < pb->order);
+}
+
+int
+path_cmp(const void *a, const void *b)
+{
+	return walk_pathcmp(a, ((const Page *)b)->path);
+}
+
+int
+rank_cmp(const void *a, const void *b)
+{
+	const Page *pa = *(Page *const *)a, *pb = *(Page *const *)b;
+
+	if (pa->rank != pb->rank)
+		return (pa->rank > pb->rank) - (pa->rank < pb->rank);
+	return (pa > pb) - (pa < pb);
+}
+
+int
+name_cmp(const void *a, const void *b)
+{
+	const Key *ka = a, *kb = b;
+	int c;
+
+	if ((c = strcmp(ka->name, kb->name)) != 0)
+		return c;
+	return (ka->value > kb->value) - (ka->value < kb->value);
+}
+
+int
+member_cmp(const void *a, const void *b)
+{
+	const Member *ma = a, *mb = b;
+
+	if (ma->bucket != mb->bucket)
+		return (ma->bucket > mb->bucket) - (ma->bucket < mb->bucket);
+	return (ma->key > mb->key) - (ma->key < mb->key);
+}
+
+int
+bucket_cmp(const void *a, const void *b)
+{
+	const Bucket *ba = a, *bb = b;
+
+	/* Largest first, while there is still room to place them. */
+	if (ba->len != bb->len)
+		return (ba->len < bb->len) - (ba->len > bb->len);
+	return (ba->bucket > bb->bucket) - (ba->bucket < bb->bucket);
+}
+
+int
+place(const Key *keys, uint32_t n, uint32_t nseeds, uint32_t *seeds,
+      uint32_t *slots)
+{
+	Member *members;
+	Bucket *buckets;
+	uint32_t *pos, nbuckets = 0, i, j, seed, s;
+	const Key *k;
+	int r = 0;
+
+	members = malloc(n * sizeof(*members));
+	buckets = malloc(n * sizeof(*buckets));
+	pos = malloc(n * sizeof(*pos));
+	if (members == NULL || buckets == NULL || pos == NULL)
+		err(1, "malloc");
+
+	for (i = 0; i < n; i++) {
+		members[i].bucket = embed_hash(0, keys[i].platform, keys[i].name) % nseeds;
+		members[i].key = i;
+	}
+	qsort(members, n, sizeof(*members), member_cmp);
+	for (i = 0; i < n; i++) {
+		if (i == 0 || members[i].bucket != members[i - 1].bucket) {
+			buckets[nbuckets].bucket = members[i].bucket;
+			buckets[nbuckets].start = i;
+			buckets[nbuckets++].len = 0;
+		}
+		buckets[nbuckets - 1].len++;
+	}
+	qsort(buckets, nbuckets, sizeof(*buckets), bucket_cmp);
+
+	memset(seeds, 0, nseeds * sizeof(*seeds));
+	for (i = 0; i < n; i++)
+		slots[i] = EMPTY;
+
+	/* Find each bucket a seed that sends all its keys to free slots. */
+	for (i = 0; i < nbuckets; i++) {
+		for (seed = 1; seed < MAX_SEED; seed++) {
+			for (j = 0; j < buckets[i].len; j++) {
+				k = &keys[members[buckets[i].start + j].key];
+				s = embed_hash(seed, k->platform, k->name) % n;
+				if (slots[s] != EMPTY)
+					break;
+				slots[s] = k->value;
+				pos[j] = s;
+			}
+			if (j == buckets[i].len)
+				break;
+			while (j-- > 0)
+				slots[pos[j]] = EMPTY;
+		}
+		if (seed == MAX_SEED) {
+			r = -1;
+			break;
+		}
+		seeds[buckets[i].bucket] = seed;
+	}
+
+	free(pos);
+	free(buckets);
+	free(members);
+	return r;
+}
+
+void
+build_table(const char *name, const Key *keys, uint32_t n)
+{
+	uint32_t *seeds = NULL, *slots, nseeds = n / BUCKET_KEYS + 1;
+	char var[64];
+
+	if ((slots = malloc((n + 1) * sizeof(*slots))) == NULL)
+		err(1, "malloc");
+	/* A stuck bucket is rare; more buckets make it rarer still. */
+	for (;; nseeds *= 2) {
+		free(seeds);
+		if ((seeds = malloc(nseeds * sizeof(*seeds))) == NULL)
+			err(1, "malloc");
+		if (n == 0 || place(keys, n, nseeds, seeds, slots) == 0)
+			break;
+		if (nseeds > n)
+			errx(1, "unable to build a perfect hash for %s", name);
+	}
+
+	snprintf(var, sizeof(var), "%s_seeds", name);
+	emit_u32s(var, seeds, n > 0 ? nseeds : 0);
+	snprintf(var, sizeof(var), "%s_slots", name);
+	emit_u32s(var, slots, n);
+	printf("const EmbedTable embed_%s = {\n"
+	       "\t%s_seeds, %lu, %s_slots, %lu\n};\n\n",
+	       name, name, (unsigned long)(n > 0 ? nseeds : 0), name,
+	       (unsigned long)n);
+	free(slots);
+	free(seeds);
+}
+
+void
+emit_string(const char *s)
+{
+	putchar('"');
+	for (; *s; s++) {
+		/* Escape ? too, so no trigraph sneaks in. */
+		if (*s == '"' || *s == '\\' || *s == '?')
+			printf("\\%c", *s);
+		else if ((unsigned char)*s < 0x20 || (unsigned char)*s >= 0x7f)
+			printf("\\%03o", (unsigned char)*s);
+		else
+			putchar(*s);
+	}
+	putchar('"');
+}
+
+void
+emit_u32s(const char *name, const uint32_t *v, uint32_t n)
+{
+	uint32_t i;
+
+	/* C has no empty arrays; a lone zero is never read. */
+	printf("static const uint32_t %s[] = {", name);
+	for (i = 0; i < n; i++)
+		printf("%s%lu,", (i % 8 == 0) ? "\n\t" : " ", (unsigned long)v[i]);
+	printf("%s};\n\n", n > 0 ? "\n" : "0");
+}
+
+int
+main(int argc, char *argv[])
+{
+	Page *pages, *p, **packed;
+	Usage *used = NULL;
+	Key *keys;
+	size_t n, i, j, kept, nused = 0;
+	uint64_t offset = 0;
+	uint32_t nnames;
+
+	if (argc != 2 && argc != 3) {
+		fprintf(stderr, "usage: embedgen archive [usage] > pages.gen.c\n");
+		return 1;
+	}
+
+	/* Sort like list_pages(); of two entries for one path, the later one
+	 * wins, as it would when extracted. */
+	n = read_pages(argv[1], &pages);
+	qsort(pages, n, sizeof(*pages), page_cmp);
+	for (i = kept = 0; i < n; i++) {
+		if (i + 1 < n && strcmp(pages[i].path, pages[i + 1].path) == 0) {
+			free(pages[i].path);
+			free(pages[i].dir);
+			free(pages[i].data);
+			continue;
+		}
+		pages[kept++] = pages[i];
+	}
+	n = kept;
+	if (n >= EMPTY)
+		errx(1, "too many pages");
+
+	/* Hot pages are stored first, most used first; the rest in order. */
+	if (argc == 3 && usage_load(argv[2], &used, &nused) == -1)
+		err(1, "%s", argv[2]);
+	for (i = 0; i < nused; i++)
+		if ((p = bsearch(used[i].page, pages, n, sizeof(*pages), path_cmp)) != NULL)
+			p->rank = i;
+	usage_free(used, nused);
+	if ((packed = malloc((n + 1) * sizeof(*packed))) == NULL)
+		err(1, "malloc");
+	for (i = 0; i < n; i++)
+		packed[i] = &pages[i];
+	qsort(packed, n, sizeof(*packed), rank_cmp);
+
+	printf("/* Generated by embedgen from %s; do not edit. */\n", argv[1]);
+	printf("#include \"embed.h\"\n\n");
+
+	printf("const unsigned char embed_data[] = {");
+	for (i = 0; i < n; i++) {
+		packed[i]->offset = offset;
+		for (j = 0; j < packed[i]->size; j++, offset++)
+			printf("%s0x%02x,", (offset % BYTES_PER_LINE == 0) ? "\n\t" : " ",
+			       packed[i]->data[j]);
+	}
+	printf("%s};\n\n", offset > 0 ? "\n" : "0");
+	if (offset > UINT32_MAX)
+		errx(1, "pages too large to embed");
+
+	printf("const EmbedPage embed_pages[] = {");
+	for (i = 0; i < n; i++) {
+		printf("\n\t{");
+		emit_string(pages[i].name);
+		printf(", ");
+		emit_string(pages[i].platform);
+		printf(", %lu, %lu, %lu},", (unsigned long)pages[i].offset,
+		       (unsigned long)pages[i].size, (unsigned long)pages[i].raw_size);
+	}
+	printf("%s};\n\n", n > 0 ? "\n" : "\n\t{\"\", \"\", 0, 0, 0}\n");
+	printf("const size_t embed_npages = %lu;\n\n", (unsigned long)n);
+
+	if ((keys = malloc((n + 1) * sizeof(*keys))) == NULL)
+		err(1, "malloc");
+	for (i = 0; i < n; i++) {
+		keys[i].platform = pages[i].platform;
+		keys[i].name = pages[i].name;
+		keys[i].value = (uint32_t)i;
+	}
+	build_table("by_path", keys, (uint32_t)n);
+
+	/* Without a platform, the first page of a name in list order wins. */
+	for (i = 0; i < n; i++)
+		keys[i].platform = NULL;
+	qsort(keys, n, sizeof(*keys), name_cmp);
+	for (i = nnames = 0; i < n; i++)
+		if (i == 0 || strcmp(keys[i].name, keys[i - 1].name) != 0)
+			keys[nnames++] = keys[i];
+	build_table("by_name", keys, nnames);
+
+	if (fflush(stdout) == EOF || ferror(stdout))
+		err(1, "stdout");
+
+	for (i = 0; i < n; i++) {
+		free(pages[i].path);
+		free(pages[i].dir);
+		free(pages[i].data);
+	}
+	free(pages);
+	free(packed);
+	free(keys);
+	return 0;
+}
@@ -0,0 +1,693 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* On-disk page index, kept next to the pages as <pages_home>.index, so that
+ * writing it does not touch the tree it describes.
+ *
+ * The file is mapped as is and all offsets are relative to its start:
+ *
+ *   header | dirs[ndirs] | pages[npages] | names[nnames] | bloom | pool
+ *
+ * Every directory is recorded with its mtime; adding or removing a page
+ * anywhere changes one of them, which is how a stale index is spotted.
+ * Pages are sorted by name and then by walk order, so the first page of a
+ * name is the one a walk of the tree would have found. Unique names double
+ * as the nodes of a BK-tree keyed on edit distance. A Bloom filter over
+ * every name and platform/name pair answers most misses without looking at
+ * the pages at all. */
+
+/* Includes */
+#include <err.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cost.h"
+#include "index.h"
+#include "walk.h"
+
+/* Constants and Macros */
+#define INDEX_MAGIC "TLDRIDX3"
+#define MAX_NAME 255 /* Longest file name we compute distances for. */
+#define BLOOM_BITS 10 /* Filter bits per key; ~1% false positives... */
+#define BLOOM_K 7     /* ...with this many probes per key. */
+
+/* Typedefs */
+typedef struct {
+	char magic[8];
+	uint32_t size;           /* Whole file, for sanity checks. */
+	uint32_t ndirs, dirs;    /* Count and offset of IdxDir. */
+	uint32_t npages, pages;  /* Count and offset of IdxPage. */
+	uint32_t nnames, names;  /* Count and offset of IdxName. */
+	uint32_t nbloom, bloom;  /* Count and offset of Bloom filter words. */
+	uint32_t pool;           /* Offset of the string pool. */
+} IdxHeader;                     /* 48 bytes, keeps IdxDir 8-byte aligned. */
+
+typedef struct {
+	int64_t sec, nsec;       /* Directory mtime at build time. */
+	uint32_t path;           /* Relative to home; "" is home itself. */
+	uint32_t pad;
+} IdxDir;
+
+typedef struct {
+	uint32_t name;           /* IdxName index. */
+	uint32_t dir;            /* IdxDir index of the parent directory. */
+} IdxPage;
+
+typedef struct {
+	uint32_t str;            /* File name in the pool. */
+	uint32_t first_page;     /* First IdxPage with this name. */
+	uint32_t child;          /* First BK-tree child; 0 for none. */
+	uint32_t sibling;        /* Next child of the same parent; 0 for none. */
+	uint32_t dist;           /* Edit distance to the parent. */
+} IdxName;
+
+struct Index {
+	unsigned char *base;
+	size_t size;
+	int mapped;              /* Unmap rather than free on close? */
+};
+
+/* A page seen during the walk. */
+typedef struct {
+	const char *name;
+	uint32_t name_off;       /* Pool offset; the pool moves as it grows. */
+	uint32_t dir;
+	uint32_t seq;
+} Ent;
+
+/* A suggestion candidate. */
+typedef struct {
+	const char *name;
+	unsigned dist;
+	int other_word;          /* Does the first word differ from the query? */
+} Hit;
+
+/* Growable byte buffer. */
+typedef struct {
+	char *data;
+	size_t len, cap;
+} Buf;
+
+/* Function prototypes */
+static int dir_cmp(const void *a, const void *b);
+static int ent_cmp(const void *a, const void *b);
+static int hit_cmp(const void *a, const void *b);
+static int buf_grow(Buf *b, size_t n);
+static uint32_t buf_add(Buf *b, const void *data, size_t n);
+static uint32_t buf_str(Buf *b, const char *s);
+static unsigned edit_distance(const char *a, const char *b);
+static size_t first_word(const char *s);
+static uint64_t bloom_hash(const char *platform, const char *name);
+static void bloom_add(uint32_t *words, uint32_t nwords, uint64_t hash);
+static int bloom_test(const uint32_t *words, uint32_t nwords, uint64_t hash);
+static int index_save(const char *home, const Buf *b);
+static int section_ok(const IdxHeader *h, uint32_t off, uint32_t count,
+                      size_t size, size_t align);
+static const IdxHeader *hdr(const Index *idx);
+static const IdxDir *dirs(const Index *idx);
+static const IdxName *names(const Index *idx);
+static const char *str(const Index *idx, uint32_t off);
+
+int
+dir_cmp(const void *a, const void *b)
+{
+	return walk_pathcmp(((const WalkEnt *)a)->path, ((const WalkEnt *)b)->path);
+}
+
+int
+ent_cmp(const void *a, const void *b)
+{
+	const Ent *x = a, *y = b;
+	int r = strcmp(x->name, y->name);
+
+	if (r != 0)
+		return r;
+	return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+int
+hit_cmp(const void *a, const void *b)
+{
+	const Hit *x = a, *y = b;
+
+	if (x->dist != y->dist)
+		return (x->dist > y->dist) - (x->dist < y->dist);
+	if (x->other_word != y->other_word)
+		return x->other_word - y->other_word;
+	return strcmp(x->name, y->name);
+}
+
+int
+buf_grow(Buf *b, size_t n)
+{
+	size_t cap = b->cap ? b->cap : 4096;
+	char *p;
+
+	while (cap - b->len < n)
+		cap *= 2;
+	if (cap == b->cap)
+		return 0;
+	if ((p = realloc(b->data, cap)) == NULL)
+		return -1;
+	b->data = p;
+	b->cap = cap;
+	return 0;
+}
+
+uint32_t
+buf_add(Buf *b, const void *data, size_t n)
+{
+	uint32_t off = (uint32_t)b->len;
+
+	memcpy(b->data + b->len, data, n);
+	b->len += n;
+	return off;
+}
+
+uint32_t
+buf_str(Buf *b, const char *s)
+{
+	size_t n = strlen(s) + 1;
+
+	if (buf_grow(b, n) == -1)
+		return UINT32_MAX;
+	return buf_add(b, s, n);
+}
+
+unsigned
+edit_distance(const char *a, const char *b)
+{
+	unsigned row[MAX_NAME + 1], diag, up, i, j;
+	size_t la = strlen(a), lb = strlen(b);
+
+	/* Farther than any two shorter names can be, which keeps it a metric
+	 * the BK-tree can prune on. */
+	if (la > MAX_NAME || lb > MAX_NAME)
+		return (strcmp(a, b) == 0) ? 0 : MAX_NAME + 1;
+
+	/* Levenshtein distance, one row at a time. */
+	for (j = 0; j <= lb; j++)
+		row[j] = j;
+	for (i = 1; i <= la; i++) {
+		diag = row[0];
+		row[0] = i;
+		for (j = 1; j <= lb; j++) {
+			up = row[j];
+			row[j] = diag + (a[i - 1] != b[j - 1]);
+			if (row[j] > up + 1)
+				row[j] = up + 1;
+			if (row[j] > row[j - 1] + 1)
+				row[j] = row[j - 1] + 1;
+			diag = up;
+		}
+	}
+	return row[lb];
+}
+
+size_t
+first_word(const char *s)
+{
+	return strcspn(s, "-.");
+}
+
+uint64_t
+bloom_hash(const char *platform, const char *name)
+{
+	uint64_t h = 0xcbf29ce484222325ULL; /* FNV-1a */
+	const char *p;
+
+	if (platform != NULL) {
+		for (p = platform; *p; p++)
+			h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+		h = (h ^ '/') * 0x100000001b3ULL;
+	}
+	for (p = name; *p; p++)
+		h = (h ^ (unsigned char)*p) * 0x100000001b3ULL;
+	return h;
+}
+
+void
+bloom_add(uint32_t *words, uint32_t nwords, uint64_t hash)
+{
+	uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1, bit;
+	int i;
+
+	/* Derive the probes from two halves of one hash (Kirsch-Mitzenmacher). */
+	for (i = 0; i < BLOOM_K; i++) {
+		bit = (h1 + (uint32_t)i * h2) % (nwords * 32);
+		words[bit / 32] |= (uint32_t)1 << (bit % 32);
+	}
+}
+
+int
+bloom_test(const uint32_t *words, uint32_t nwords, uint64_t hash)
+{
+	uint32_t h1 = (uint32_t)hash, h2 = (uint32_t)(hash >> 32) | 1, bit;
+	int i;
+
+	for (i = 0; i < BLOOM_K; i++) {
+		bit = (h1 + (uint32_t)i * h2) % (nwords * 32);
+		if (!(words[bit / 32] & (uint32_t)1 << (bit % 32)))
+			return 0;
+	}
+	return 1;
+}
+
+int
+sidecar_path(char *buf, size_t size, const char *home, const char *suffix)
+{
+	size_t len = strlen(home);
+	int n;
+
+	/* "pages/" must not put the file inside the tree. */
+	while (len > 1 && home[len - 1] == '/')
+		len--;
+	n = snprintf(buf, size, "%.*s%s", (int)len, home, suffix);
+	return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+int
+index_save(const char *home, const Buf *b)
+{
+	char path[4096], tmp[4096 + 8];
+	int fd;
+
+	if (sidecar_path(path, sizeof(path), home, INDEX_SUFFIX) == -1)
+		return -1;
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+
+	/* Readers either see the old index or the new one. */
+	if ((fd = mkstemp(tmp)) == -1)
+		return -1;
+	COST_ADD(opens, 1);
+	COST_ADD(writes, 1);
+	if (write(fd, b->data, b->len) != (ssize_t)b->len ||
+	    fchmod(fd, 0644) == -1 || close(fd) == -1) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+	if (rename(tmp, path) == -1) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+int
+index_build(const char *home, Index **idx)
+{
+	Buf pool = {0}, out = {0};
+	Ent *ents = NULL;
+	IdxDir *dv = NULL;
+	IdxHeader h = {INDEX_MAGIC, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+	IdxPage *pages;
+	IdxName *nv;
+	uint32_t *bloom;
+	const char *platform, *slash;
+	size_t nents = 0, ndirs = 0, i, nnames;
+	uint32_t node, child, d;
+	char parent[PATH_MAX];
+	WalkEnt key, *dir;
+	Walk w;
+	int r = -1;
+
+	if (idx != NULL)
+		*idx = NULL;
+
+	if (walk_tree(home, &w) == -1) {
+		warn("unable to walk %s", home);
+		return -1;
+	}
+	if (w.ndirs == 0)
+		goto out; /* No tree, nothing to index. */
+
+	/* Offset 0 of the pool is the empty string. */
+	if (buf_str(&pool, "") == UINT32_MAX)
+		goto out;
+
+	if ((dv = malloc(w.ndirs * sizeof(*dv))) == NULL)
+		goto out;
+	for (ndirs = 0; ndirs < w.ndirs; ndirs++) {
+		dv[ndirs].sec = w.dirs[ndirs].sec;
+		dv[ndirs].nsec = w.dirs[ndirs].nsec;
+		dv[ndirs].pad = 0;
+		dv[ndirs].path = buf_str(&pool, w.dirs[ndirs].path);
+		if (dv[ndirs].path == UINT32_MAX)
+			goto out;
+	}
+
+	if (w.nfiles > 0 && (ents = malloc(w.nfiles * sizeof(*ents))) == NULL)
+		goto out;
+	for (nents = 0; nents < w.nfiles; nents++) {
+		/* Both lists are sorted, so the parent is a binary search away. */
+		slash = strrchr(w.files[nents].path, '/');
+		i = slash ? (size_t)(slash - w.files[nents].path) : 0;
+		if (i >= sizeof(parent))
+			goto out;
+		memcpy(parent, w.files[nents].path, i);
+		parent[i] = 0;
+		key.path = parent;
+		dir = bsearch(&key, w.dirs, w.ndirs, sizeof(WalkEnt), dir_cmp);
+		if (dir == NULL)
+			goto out;
+		ents[nents].name_off = buf_str(&pool, w.files[nents].name);
+		ents[nents].dir = (uint32_t)(dir - w.dirs);
+		ents[nents].seq = (uint32_t)nents;
+		if (ents[nents].name_off == UINT32_MAX)
+			goto out;
+	}
+
+	for (i = 0; i < nents; i++)
+		ents[i].name = pool.data + ents[i].name_off;
+	qsort(ents, nents, sizeof(*ents), ent_cmp);
+
+	/* Lay out the file; the pool goes last so it can be copied as is. */
+	h.ndirs = (uint32_t)ndirs;
+	h.npages = (uint32_t)nents;
+	h.dirs = sizeof(h);
+	h.pages = h.dirs + h.ndirs * sizeof(IdxDir);
+	h.names = h.pages + h.npages * sizeof(IdxPage);
+	for (nnames = 0, i = 0; i < nents; i++)
+		nnames += (i == 0 || strcmp(ents[i - 1].name, ents[i].name) != 0);
+	h.nnames = (uint32_t)nnames;
+	h.bloom = h.names + h.nnames * sizeof(IdxName);
+	/* Each page adds two keys: its name and platform/name. */
+	h.nbloom = (uint32_t)((nents * 2 * BLOOM_BITS + 31) / 32) + 1;
+	h.pool = h.bloom + h.nbloom * sizeof(uint32_t);
+	h.size = h.pool + (uint32_t)pool.len;
+
+	if (buf_grow(&out, h.size) == -1)
+		goto out;
+	memset(out.data, 0, h.size);
+	out.len = h.size;
+	memcpy(out.data, &h, sizeof(h));
+	memcpy(out.data + h.dirs, dv, ndirs * sizeof(IdxDir));
+	memcpy(out.data + h.pool, pool.data, pool.len);
+	pages = (IdxPage *)(out.data + h.pages);
+	nv = (IdxName *)(out.data + h.names);
+	bloom = (uint32_t *)(out.data + h.bloom);
+
+	for (nnames = 0, i = 0; i < nents; i++) {
+		if (i == 0 || strcmp(ents[i - 1].name, ents[i].name) != 0) {
+			nv[nnames].str = ents[i].name_off;
+			nv[nnames].first_page = (uint32_t)i;
+			nnames++;
+		}
+		pages[i].name = (uint32_t)nnames - 1;
+		pages[i].dir = ents[i].dir;
+
+		/* Platform is the parent's name, as find_page() sees it. */
+		platform = pool.data + dv[ents[i].dir].path;
+		if (*platform == 0)
+			platform = walk_parent(home, "", parent, sizeof(parent));
+		else if (strrchr(platform, '/') != NULL)
+			platform = strrchr(platform, '/') + 1;
+		bloom_add(bloom, h.nbloom, bloom_hash(NULL, ents[i].name));
+		bloom_add(bloom, h.nbloom, bloom_hash(platform, ents[i].name));
+	}
+
+	/* Hang every name off the BK-tree rooted at name 0. */
+	for (i = 1; i < nnames; i++) {
+		node = 0;
+		d = edit_distance(out.data + h.pool + nv[i].str,
+		                  out.data + h.pool + nv[node].str);
+		for (;;) {
+			for (child = nv[node].child; child != 0; child = nv[child].sibling)
+				if (nv[child].dist == d)
+					break;
+			if (child == 0)
+				break;
+			node = child;
+			d = edit_distance(out.data + h.pool + nv[i].str,
+			                  out.data + h.pool + nv[node].str);
+		}
+		nv[i].dist = d;
+		nv[i].sibling = nv[node].child;
+		nv[node].child = (uint32_t)i;
+	}
+
+	r = index_save(home, &out);
+	if (idx != NULL && (*idx = malloc(sizeof(Index))) != NULL) {
+		(*idx)->base = (unsigned char *)out.data;
+		(*idx)->size = out.len;
+		(*idx)->mapped = 0;
+		out.data = NULL;
+	}
+
+out:
+	walk_free(&w);
+	free(ents);
+	free(dv);
+	free(pool.data);
+	free(out.data);
+	return r;
+}
+
+int
+section_ok(const IdxHeader *h, uint32_t off, uint32_t count, size_t size,
+           size_t align)
+{
+	/* Between the header and the pool, and aligned for its entries. */
+	return off >= sizeof(IdxHeader) && off % align == 0 &&
+	       (uint64_t)off + (uint64_t)count * size <= h->pool;
+}
+
+const IdxHeader *
+hdr(const Index *idx)
+{
+	return (const IdxHeader *)idx->base;
+}
+
+const IdxDir *
+dirs(const Index *idx)
+{
+	return (const IdxDir *)(idx->base + hdr(idx)->dirs);
+}
+
+const IdxName *
+names(const Index *idx)
+{
+	return (const IdxName *)(idx->base + hdr(idx)->names);
+}
+
+const char *
+str(const Index *idx, uint32_t off)
+{
+	const IdxHeader *h = hdr(idx);
+
+	/* The pool ends in a NUL, so any offset inside it is a string. */
+	if (off >= h->size - h->pool)
+		off = 0;
+	return (const char *)idx->base + h->pool + off;
+}
+
+Index *
+index_open(const char *home)
+{
+	char path[4096];
+	const IdxHeader *h;
+	const IdxDir *d;
+	struct stat st;
+	Index *idx;
+	int fd;
+
+	if (sidecar_path(path, sizeof(path), home, INDEX_SUFFIX) == -1)
+		return NULL;
+	COST_ADD(opens, 1);
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return NULL;
+	if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(IdxHeader) ||
+	    (idx = malloc(sizeof(Index))) == NULL) {
+		close(fd);
+		return NULL;
+	}
+	idx->size = (size_t)st.st_size;
+	idx->mapped = 1;
+	idx->base = mmap(NULL, idx->size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (idx->base == MAP_FAILED) {
+		free(idx);
+		return NULL;
+	}
+
+	/* Reject anything we did not write, then anything out of date. */
+	h = hdr(idx);
+	if (memcmp(h->magic, INDEX_MAGIC, sizeof(h->magic)) != 0 ||
+	    h->size != idx->size || h->pool >= h->size ||
+	    idx->base[h->size - 1] != 0)
+		goto stale;
+	/* A truncated or corrupt file must not send a lookup outside it. */
+	if (!section_ok(h, h->dirs, h->ndirs, sizeof(IdxDir), sizeof(int64_t)) ||
+	    !section_ok(h, h->pages, h->npages, sizeof(IdxPage), 4) ||
+	    !section_ok(h, h->names, h->nnames, sizeof(IdxName), 4) ||
+	    !section_ok(h, h->bloom, h->nbloom, sizeof(uint32_t), 4) ||
+	    h->nbloom == 0 || h->nbloom > UINT32_MAX / 32)
+		goto stale;
+	/* The root sorts first. Its mtime is the one stamp checked here:
+	 * updates rebuild the index, and a lookup that falls through calls
+	 * index_fresh() to catch pages changed by hand. */
+	d = dirs(idx);
+	if (h->ndirs == 0 || *str(idx, d[0].path) != 0)
+		goto stale;
+	COST_ADD(stats, 1);
+	if (stat(home, &st) == -1 || st.st_mtim.tv_sec != d[0].sec ||
+	    st.st_mtim.tv_nsec != d[0].nsec)
+		goto stale;
+	return idx;
+
+stale:
+	index_close(idx);
+	return NULL;
+}
+
+int
+index_fresh(const Index *idx, const char *home)
+{
+	char path[4096];
+	const IdxDir *d = dirs(idx);
+	struct stat st;
+	uint32_t i;
+	int n;
+
+	for (i = 0; i < hdr(idx)->ndirs; i++) {
+		n = snprintf(path, sizeof(path), "%s/%s", home, str(idx, d[i].path));
+		COST_ADD(stats, 1);
+		if (n < 0 || (size_t)n >= sizeof(path) || stat(path, &st) == -1 ||
+		    st.st_mtim.tv_sec != d[i].sec || st.st_mtim.tv_nsec != d[i].nsec)
+			return 0;
+	}
+	return 1;
+}
+
+void
+index_close(Index *idx)
+{
+	if (idx == NULL)
+		return;
+	if (idx->mapped)
+		munmap(idx->base, idx->size);
+	else
+		free(idx->base);
+	free(idx);
+}
+
+int
+index_maybe_has(const Index *idx, const char *name, const char *platform)
+{
+	const IdxHeader *h = hdr(idx);
+
+	return bloom_test((const uint32_t *)(idx->base + h->bloom), h->nbloom,
+	                  bloom_hash(platform, name));
+}
+
+int
+index_find(const Index *idx, const char *home, const char *name,
+           const char *platform, char *buf, size_t size)
+{
+	const IdxHeader *h = hdr(idx);
+	const IdxName *nv = names(idx);
+	const IdxPage *pv = (const IdxPage *)(idx->base + h->pages);
+	const char *dir, *parent;
+	char root[PATH_MAX];
+	uint32_t lo = 0, hi = h->nnames, mid = 0, i;
+	int c, n;
+
+	if (!index_maybe_has(idx, name, platform))
+		return -1;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		COST_ADD(probes, 1);
+		if ((c = strcmp(name, str(idx, nv[mid].str))) == 0)
+			break;
+		if (c < 0)
+			hi = mid;
+		else
+			lo = mid + 1;
+	}
+	if (lo >= hi)
+		return -1;
+
+	/* Pages of a name are adjacent and in walk order; take the first that
+	 * sits on platform. */
+	for (i = nv[mid].first_page; i < h->npages && pv[i].name == mid; i++) {
+		COST_ADD(probes, 1);
+		if (pv[i].dir >= h->ndirs)
+			continue; /* Corrupt. */
+		dir = str(idx, dirs(idx)[pv[i].dir].path);
+		if (platform != NULL) {
+			if (*dir == 0)
+				parent = walk_parent(home, "", root, sizeof(root));
+			else if ((parent = strrchr(dir, '/')) != NULL)
+				parent++;
+			else
+				parent = dir;
+			if (strcmp(parent, platform) != 0)
+				continue;
+		}
+		n = snprintf(buf, size, "%s%s%s", dir, *dir ? "/" : "", name);
+		return (n < 0 || (size_t)n >= size) ? -1 : 0;
+	}
+	return -1;
+}
+
+int
+index_suggest(const Index *idx, const char *name, unsigned tol,
+              const char *out[], int max)
+{
+	const IdxName *nv = names(idx);
+	uint32_t nnames = hdr(idx)->nnames, *stack, top = 0, node, child;
+	size_t word = first_word(name);
+	Hit *hits;
+	size_t nhits = 0, steps;
+	unsigned d;
+	int n;
+
+	if (nnames == 0 || max <= 0)
+		return 0;
+	stack = malloc(nnames * sizeof(*stack));
+	hits = malloc(nnames * sizeof(*hits));
+	if (stack == NULL || hits == NULL) {
+		free(stack);
+		free(hits);
+		return 0;
+	}
+
+	/* Only children within tol of d can hold a match (triangle rule). A
+	 * tree takes fewer than 2 * nnames steps; a corrupt one is cut off. */
+	stack[top++] = 0;
+	for (steps = 2 * (size_t)nnames; top > 0 && steps > 0; steps--) {
+		node = stack[--top];
+		COST_ADD(probes, 1);
+		d = edit_distance(name, str(idx, nv[node].str));
+		if (d <= tol && d > 0 && nhits < nnames) {
+			hits[nhits].name = str(idx, nv[node].str);
+			hits[nhits].dist = d;
+			hits[nhits].other_word = first_word(hits[nhits].name) != word ||
+			    strncmp(hits[nhits].name, name, word) != 0;
+			nhits++;
+		}
+		for (child = nv[node].child; child != 0 && child < nnames &&
+		     top < nnames && steps > 1; child = nv[child].sibling, steps--)
+			if ((uint64_t)nv[child].dist + tol >= d &&
+			    nv[child].dist <= (uint64_t)d + tol)
+				stack[top++] = child;
+	}
+
+	/* Subcommands of the same tool rank first among equals. */
+	qsort(hits, nhits, sizeof(*hits), hit_cmp);
+	for (n = 0; n < max && (size_t)n < nhits; n++)
+		out[n] = hits[n].name;
+
+	free(stack);
+	free(hits);
+	return n;
+}
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stddef.h>
+
+#define INDEX_SUFFIX ".index" /* Kept next to the pages. */
+
+typedef struct Index Index; /* Defined in index.c */
+
+/* Build "<home><suffix>", the path of a file kept next to the pages. */
+int sidecar_path(char *buf, size_t size, const char *home, const char *suffix);
+/* Walk home and write a fresh index next to it. If idx is not NULL, the
+ * new index is returned there even if it could not be saved. */
+int index_build(const char *home, Index **idx);
+/* Map the saved index; NULL if it is missing or older than the root of
+ * the tree. One stat, however many directories there are. */
+Index *index_open(const char *home);
+/* Return 1 if no directory changed since the index was built, 0 if one
+ * did. Stats every directory, so only worth it once a lookup falls
+ * through. */
+int index_fresh(const Index *idx, const char *home);
+/* Release the index. */
+void index_close(Index *idx);
+/* Return 0 if no page called name exists on platform (any platform if
+ * NULL), 1 if one might. */
+int index_maybe_has(const Index *idx, const char *name, const char *platform);
+/* Write the path, relative to home, of the page a walk of the tree would
+ * find first for name on platform (any platform if NULL) into buf.
+ * Return -1 if there is none. */
+int index_find(const Index *idx, const char *home, const char *name,
+               const char *platform, char *buf, size_t size);
+/* Fill out with up to max page names at most tol edits away from name,
+ * closest first. The names live as long as the index. */
+int index_suggest(const Index *idx, const char *name, unsigned tol,
+                  const char *out[], int max);
+
+#endif /* INDEX_H */
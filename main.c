@@ -1,17 +1,20 @@
 /* SPDX-License-Identifier: MIT
  * Copyright (c) 2026 Ivan Kovmir */
+#include <ctype.h>
 #include <err.h>
+#include <errno.h>
 #include <getopt.h>
 #include <limits.h>
+#include <pwd.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
-#include <wordexp.h>
 
 #include "tldr.h"
 
 #define SUPPORT_URL "https://github.com/kovmir/tinytldr/issues"
+#define MAX_SUGGESTIONS 5
 #ifndef GIT_VERSION
 #define GIT_VERSION "dev"
 #endif /* GIT_VERSION */
@@ -22,50 +25,117 @@ void parse_cli_opts(int argc, char *argv[]);
 void print_help(FILE *out);
 /* Download and extract newest pages. */
 void run_update(Config *cfg);
-/* Print the requested page to the terminal. */
-void run_display(Config *cfg, const char *name, const char *platform);
+/* Find the page for the given words, saying which it is if it took fewer
+ * words than given, and exit if there is none. */
+char *run_resolve(Config *cfg, const char *home, char *const words[], int n,
+                  const char *platform);
+/* Join words with dashes into buf, as many as fit; return how many. */
+int join_words(char *buf, size_t size, char *const words[], int n);
+/* Print the page at path to the terminal. */
+void run_display(Config *cfg, const char *path);
+/* Print every page named on stdin. */
+void run_batch(Config *cfg, const char *home, const char *platform);
+/* Write every page in the given format. */
+void run_export(Config *cfg, const char *format);
+/* Report a missing page along with similar names and exit. */
+void not_found(Config *cfg, const char *name);
+/* Write where the pages live into buf. */
+int pages_home(char *buf, size_t size);
+/* Parse a non-negative number, optionally with a k, m or g suffix. */
+long parse_number(const char *s, const char *opt, int suffix);
 
 #include "config.h"
 
+static int batch_flag = 0;
+static char *export_format = NULL;
+static long jitter_opt = -1;
 static int list_flag = 0;
+static const char **mirrors = NULL;
+static size_t nmirrors = 0;
 static char *page_platform = NULL;
+static long rate_opt = -1;
+static long retries_opt = -1;
+static long stall_opt = -1;
 static int target_flag = 0;
+static long timeout_opt = -1;
 static int update_flag = 0;
+static int warm_flag = 0;
 
 void
 parse_cli_opts(int argc, char *argv[])
 {
+	const char **tmp;
 	int opt;
 	static struct option long_options[] = {
+		{"batch",    no_argument,       0, 'b'},
+		{"export",   required_argument, 0, 'e'},
 		{"help",     no_argument,       0, 'h'},
+		{"jitter",   required_argument, 0, 'j'},
 		{"list",     no_argument,       0, 'l'},
+		{"mirror",   required_argument, 0, 'm'},
 		{"platform", required_argument, 0, 'p'},
+		{"rate",     required_argument, 0, 'r'},
+		{"retries",  required_argument, 0, 'R'},
+		{"stall",    required_argument, 0, 's'},
 		{"target",   no_argument,       0, 't'},
+		{"timeout",  required_argument, 0, 'T'},
 		{"update",   no_argument,       0, 'u'},
 		{"version",  no_argument,       0, 'v'},
+		{"warm",     no_argument,       0, 'w'},
 		{0, 0, 0, 0} /* Must be last. */
 	};
 
-	while ((opt = getopt_long(argc, argv, "hlp:tuv", long_options, NULL)) != -1) {
+	while ((opt = getopt_long(argc, argv, "+be:hj:lm:p:r:R:s:tT:uvw", long_options, NULL)) != -1) {
 		switch (opt) {
+		case 'b':
+			batch_flag = 1;
+			break;
+		case 'e':
+			export_format = optarg;
+			break;
 		case 'h':
 			print_help(stdout);
 			exit(0);
+		case 'j':
+			jitter_opt = parse_number(optarg, "jitter", 0);
+			break;
 		case 'l':
 			list_flag = 1;
 			break;
+		case 'm':
+			tmp = realloc(mirrors, (nmirrors + 1) * sizeof(*mirrors));
+			if (tmp == NULL)
+				err(1, "realloc");
+			mirrors = tmp;
+			mirrors[nmirrors++] = optarg;
+			break;
 		case 'p':
 			page_platform = optarg;
 			break;
+		case 'r':
+			rate_opt = parse_number(optarg, "rate", 1);
+			break;
+		case 'R':
+			retries_opt = parse_number(optarg, "retries", 0);
+			break;
+		case 's':
+			stall_opt = parse_number(optarg, "stall", 0);
+			break;
 		case 't':
 			target_flag = 1;
 			break;
+		case 'T':
+			timeout_opt = parse_number(optarg, "timeout", 0);
+			break;
 		case 'u':
 			update_flag = 1;
 			break;
 		case 'v':
 			puts(GIT_VERSION);
 			exit(0);
+		case 'w':
+			warm_flag = 1;
+			break;
 		default:
 			print_help(stderr);
 			exit(-1);
@@ -73,27 +143,63 @@ parse_cli_opts(int argc, char *argv[])
 	}
 }
 
+long
+parse_number(const char *s, const char *opt, int suffix)
+{
+	static const char units[] = "kmg";
+	const char *u;
+	char *end;
+	long n;
+	int i;
+
+	errno = 0;
+	n = strtol(s, &end, 10);
+	if (suffix && *end != 0 && end[1] == 0 &&
+	    (u = strchr(units, tolower((unsigned char)*end))) != NULL) {
+		for (i = (int)(u - units) + 1; i > 0; i--)
+			n = (n > LONG_MAX / 1024) ? LONG_MAX : n * 1024;
+		end++;
+	}
+	if (end == s || *end != 0 || errno != 0 || n < 0 || n > INT_MAX)
+		errx(1, "invalid --%s: %s", opt, s);
+	return n;
+}
+
 void
 print_help(FILE *out)
 {
-	fprintf(out, "usage: tldr [-h] [-l] [-p PLATFORM] [-t] [-u] [-v] PAGE...\n");
+	fprintf(out, "usage: tldr [-b] [-e FORMAT] [-h] [-l] [-m URL]... [-p PLATFORM] [-t] [-u] [-v] [-w]\n");
+	fprintf(out, "            [-j SECONDS] [-r RATE] [-R RETRIES] [-s SECONDS] [-T SECONDS] PAGE...\n");
 	fprintf(out, "\n");
 	fprintf(out, "Options:\n");
+	fprintf(out, "  -b, --batch       show every page named on stdin\n");
+	fprintf(out, "  -e, --export      write all pages as ansi, text, html or json\n");
 	fprintf(out, "  -h, --help        show this help message\n");
+	fprintf(out, "  -j, --jitter      wait up to SECONDS at random before updating\n");
 	fprintf(out, "  -l, --list        list all available pages\n");
+	fprintf(out, "  -m, --mirror      also download pages from URL; repeatable\n");
 	fprintf(out, "  -p, --platform    specify page platform (e.g. linux, osx, common)\n");
+	fprintf(out, "  -r, --rate        download at most RATE bytes per second (e.g. 500k)\n");
+	fprintf(out, "  -R, --retries     retry a failed update RETRIES times\n");
+	fprintf(out, "  -s, --stall       abort downloads stalled for SECONDS\n");
 	fprintf(out, "  -t, --target      show page path instead of the page\n");
+	fprintf(out, "  -T, --timeout     give up on updating after SECONDS\n");
 	fprintf(out, "  -u, --update      download tldr pages\n");
 	fprintf(out, "  -v, --version     show version\n");
+	fprintf(out, "  -w, --warm        read the index and most used pages ahead\n");
 	fprintf(out, "\n");
 	fprintf(out, "Arguments:\n");
-	fprintf(out, "  PAGE              page name (e.g. tar, git commit)\n");
+	fprintf(out, "  PAGE              page name (e.g. tar, git commit --amend)\n");
 	fprintf(out, "\n");
 	fprintf(out, "Examples:\n");
 	fprintf(out, "  tldr tar\n");
 	fprintf(out, "  tldr git commit\n");
 	fprintf(out, "  tldr -p osx tar\n");
 	fprintf(out, "  tldr -u\n");
+	fprintf(out, "  tldr -m http://cache.lan/tldr-pages.en.zip -u\n");
+	fprintf(out, "  tldr -j 3600 -r 200k -T 900 -u\n");
+	fprintf(out, "  tldr -l | grep ^linux/ | tldr -b\n");
+	fprintf(out, "  tldr -e html > tldr.html\n");
 	fprintf(out, "\n");
 	fprintf(out, "Support: "SUPPORT_URL"\n");
 }
@@ -101,79 +207,239 @@ print_help(FILE *out)
 void
 run_update(Config *cfg)
 {
-	FILE *temp_file;
+	FetchReport report;
+
+	if (update_pages(cfg, &report) == -1)
+		errx(1, "unable to update pages");
+	if (report.delta) {
+		printf("fetched %zu bytes in %zu changed pages\n",
+		       report.bytes, report.changed);
+	} else {
+		printf("fetched %zu bytes, sha256 %s (%s)\n", report.bytes,
+		       report.sha256, report.verified ? "verified" : "unverified");
+	}
+}
+
+void
+not_found(Config *cfg, const char *name)
+{
+	char *list[MAX_SUGGESTIONS];
+	char msg[MAX_SUGGESTIONS * (NAME_MAX + 2)] = {0};
+	int i, n;
+
+	n = suggest_pages(cfg, name, list, MAX_SUGGESTIONS);
+	if (n == 0)
+		errx(1, "not found");
+
+	for (i = 0; i < n; i++) {
+		if (i > 0)
+			strcat(msg, ", ");
+		strncat(msg, list[i], NAME_MAX);
+		free(list[i]);
+	}
+	errx(1, "not found; did you mean %s?", msg);
+}
+
+int
+join_words(char *buf, size_t size, char *const words[], int n)
+{
+	size_t len = 0, wlen;
+	int i;
 
-	temp_file = tmpfile();
-	if (temp_file == NULL)
-		err(1, "unable to open create a temporary file");
+	buf[0] = 0;
+	for (i = 0; i < n; i++) {
+		wlen = strlen(words[i]);
+		if (len + (i > 0) + wlen >= size)
+			break;
+		if (i > 0)
+			buf[len++] = '-';
+		memcpy(buf + len, words[i], wlen + 1);
+		len += wlen;
+	}
+	return i;
+}
 
-	/* Download. */
-	if (fetch_pages(cfg, temp_file) == -1)
-		errx(1, "unable to fetch pages");
-	rewind(temp_file);
-	/* Extract. */
-	if (extract_pages(cfg, temp_file) == -1)
-		errx(1, "unable to extract pages");
+int
+pages_home(char *buf, size_t size)
+{
+	const char *base, *rest;
+	struct passwd *pw;
+	int n;
 
-	fclose(temp_file);
+	if (PAGES_HOME != NULL && strncmp(PAGES_HOME, "~/", 2) != 0) {
+		base = "";
+		rest = PAGES_HOME;
+	} else if (PAGES_HOME == NULL &&
+	           (base = getenv("XDG_DATA_HOME")) != NULL && base[0] == '/') {
+		rest = "/tinytldr/pages";
+	} else {
+		/* Only a login without $HOME pays for the passwd lookup. */
+		if ((base = getenv("HOME")) == NULL || base[0] == 0)
+			base = (pw = getpwuid(getuid())) != NULL ? pw->pw_dir : NULL;
+		if (base == NULL)
+			return -1;
+		rest = PAGES_HOME != NULL ? PAGES_HOME + 1 :
+		       "/.local/share/tinytldr/pages";
+	}
+	n = snprintf(buf, size, "%s%s", base, rest);
+	return (n < 0 || (size_t)n >= size) ? -1 : 0;
+}
+
+char *
+run_resolve(Config *cfg, const char *home, char *const words[], int n,
+            const char *platform)
+{
+	char name[NAME_MAX + 1];
+	char *path;
+	int used;
+
+	if ((path = resolve_page(cfg, words, n, platform, &used)) == NULL) {
+#ifndef EMBED_PAGES
+		/* Only now is it worth telling a miss from no pages at all. */
+		if (access(home, F_OK) == -1)
+			errx(1, "no pages; try to --update");
+#else
+		(void)home;
+#endif /* EMBED_PAGES */
+		join_words(name, sizeof(name) - strlen(".md"), words, n);
+		strcat(name, ".md");
+		not_found(cfg, name);
+	}
+	if (used < n) {
+		join_words(name, sizeof(name), words, used);
+		warnx("showing %s, ignoring %s%s", name, words[used],
+		      n - used > 1 ? " ..." : "");
+	}
+	return path;
 }
 
 void
-run_display(Config *cfg, const char *name, const char *platform)
+run_display(Config *cfg, const char *path)
 {
-	char *page_path;
-	FILE *page_file;
+	if (show_page(cfg, path) == -1)
+		errx(1, "unable to display %s", path);
+}
 
-	/* Find page. */
-	page_path = find_page(cfg, name, platform);
-	if (page_path == NULL)
-		errx(1, "not found");
-	/* Open page. */
-	page_file = fopen(page_path, "rb");
-	if (page_file == NULL)
-		err(1, "unable to open %s", page_path);
-	/* Display page. */
-	if (print_page(cfg, page_file) == -1)
-		errx(1, "unable to display %s", page_path);
-
-	fclose(page_file);
-	free(page_path);
+void
+run_batch(Config *cfg, const char *home, const char *platform)
+{
+	char **paths = NULL, **tmp;
+	char *line = NULL, *p;
+	char name[NAME_MAX + 1];
+	size_t cap = 0, n = 0, size = 0, i;
+	ssize_t len;
+	int failed = 0;
+
+	/* One page per line: list entries (platform/name.md) or page names. */
+	while ((len = getline(&line, &size, stdin)) != -1) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = 0;
+		if (len == 0)
+			continue;
+		if (n == cap) {
+			cap = cap ? cap * 2 : 64;
+			if ((tmp = realloc(paths, cap * sizeof(*paths))) == NULL)
+				err(1, "realloc");
+			paths = tmp;
+		}
+		if (strchr(line, '/') != NULL) {
+			if ((p = malloc(strlen(home) + len + 2)) == NULL)
+				err(1, "malloc");
+			sprintf(p, "%s/%s", home, line);
+		} else {
+			snprintf(name, sizeof(name), "%s.md", line);
+			for (p = name; *p; p++)
+				if (*p == ' ')
+					*p = '-';
+			if ((p = find_page(cfg, name, platform)) == NULL) {
+				warnx("%s: not found", line);
+				failed = 1;
+				continue;
+			}
+		}
+		paths[n++] = p;
+	}
+	free(line);
+
+	if (print_pages(cfg, paths, n) == -1)
+		failed = 1;
+	for (i = 0; i < n; i++)
+		free(paths[i]);
+	free(paths);
+	if (failed)
+		exit(1);
+}
+
+void
+run_export(Config *cfg, const char *format)
+{
+	static const char *names[] = {
+		[EXPORT_ANSI] = "ansi",
+		[EXPORT_TEXT] = "text",
+		[EXPORT_HTML] = "html",
+		[EXPORT_JSON] = "json",
+	};
+	size_t i;
+
+	for (i = 0; i < sizeof(names) / sizeof(names[0]); i++)
+		if (strcmp(format, names[i]) == 0)
+			break;
+	if (i == sizeof(names) / sizeof(names[0]))
+		errx(1, "unknown export format %s", format);
+	if (export_pages(cfg, (int)i) == -1)
+		errx(1, "unable to export pages");
 }
 
 int
 main(int argc, char *argv[])
 {
 	Config *cfg;
-	char page_name[NAME_MAX] = {0};
-	char expanded_home[PATH_MAX] = {0};
-	wordexp_t w;
-	int first;
+	char *path;
+	char home[PATH_MAX];
+	const char **tmp;
+	size_t i;
 
 	/* CLI options. */
 	parse_cli_opts(argc, argv);
 	argc -= optind;
 	argv += optind;
 
-	/* Expand ~ */
-	if (wordexp(PAGES_HOME, &w, 0) != 0)
-		errx(1, "shell unable to expand %s", PAGES_HOME);
-	if (w.we_wordc < 1)
-		errx(1, "invalid %s", PAGES_HOME);
-	snprintf(expanded_home, PATH_MAX, "%s", w.we_wordv[0]);
-	wordfree(&w);
+	/* Mirrors from the command line go before the configured ones. */
+	for (i = 0; PAGES_MIRRORS[i] != NULL; i++)
+		;
+	if ((tmp = realloc(mirrors, (nmirrors + i + 1) * sizeof(*mirrors))) == NULL)
+		err(1, "realloc");
+	mirrors = tmp;
+	memcpy(mirrors + nmirrors, PAGES_MIRRORS, (i + 1) * sizeof(*mirrors));
+
+	if (pages_home(home, sizeof(home)) == -1)
+		errx(1, "unable to tell where pages live; set HOME");
 
 	cfg = create_cfg(&(ConfigOpts){
-		.pages_url     = PAGES_URL,
-		.pages_home    = expanded_home,
-		.user_agent    = "tinytldr/"GIT_VERSION,
-		.heading_style = HEADING_STYLE,
-		.summary_style = SUMMARY_STYLE,
-		.comment_style = COMMENT_STYLE,
-		.command_style = COMMAND_STYLE,
-		.reset_style   = RESET_STYLE,
-		.skip_empty    = SKIP_EMPTY,
-		.apply_styles  = APPLY_STYLES,
-		.out           = stdout,
+		.pages_url         = PAGES_URL,
+		.pages_sha256      = PAGES_SHA256,
+		.sums_url          = SUMS_URL,
+		.mirrors           = mirrors,
+		.pages_home        = home,
+		.user_agent        = "tinytldr/"GIT_VERSION,
+		.heading_style     = HEADING_STYLE,
+		.summary_style     = SUMMARY_STYLE,
+		.comment_style     = COMMENT_STYLE,
+		.command_style     = COMMAND_STYLE,
+		.code_style        = CODE_STYLE,
+		.placeholder_style = PLACEHOLDER_STYLE,
+		.reset_style       = RESET_STYLE,
+		.delta_update      = DELTA_UPDATE,
+		.max_rate          = rate_opt >= 0 ? rate_opt : MAX_RATE,
+		.low_speed_limit   = LOW_SPEED_LIMIT,
+		.low_speed_time    = stall_opt >= 0 ? stall_opt : LOW_SPEED_TIME,
+		.timeout           = timeout_opt >= 0 ? timeout_opt : UPDATE_TIMEOUT,
+		.retries           = retries_opt >= 0 ? (int)retries_opt : UPDATE_RETRIES,
+		.start_jitter      = jitter_opt >= 0 ? jitter_opt : START_JITTER,
+		.track_usage       = TRACK_USAGE,
+		.skip_empty        = SKIP_EMPTY,
+		.apply_styles      = APPLY_STYLES,
+		.out               = stdout,
 	});
 	if (cfg == NULL)
 		err(1, "unable to allocate config");
@@ -190,40 +456,54 @@ main(int argc, char *argv[])
 		return 0;
 	}
 
+	/* Prefetch the index and hot pages, e.g. after boot. */
+	if (warm_flag == 1) {
+		if (warm_pages(cfg) == -1)
+			errx(1, "unable to warm pages");
+		return 0;
+	}
+
+	/* Export all pages. */
+	if (export_format != NULL) {
+		run_export(cfg, export_format);
+		return 0;
+	}
+
+	/* Show pages named on stdin. */
+	if (batch_flag == 1) {
+		run_batch(cfg, home, page_platform);
+		return 0;
+	}
+
 	if (argc < 1) {
 		/* No options and no arguments. */
 		print_help(stderr);
 		exit(-1);
 	}
 
-	if (access(expanded_home, F_OK) == -1) {
-		/* Page requested, but there are no pages on disk. */
-		errx(1, "no pages; try to --update");
-	}
-
-	/* Combine CLI args into a single page file name. */
-	first = 1;
-	while (argc-- > 0) {
-		/* Buffer overflow is possible, but not by accident. */
-		if (!first) {
-			strcat(page_name, "-");
-		}
-		first = 0;
-		strcat(page_name, *argv++);
-	}
-	strcat(page_name, ".md");
+	/* The longest run of leading words that names a page. */
+	path = run_resolve(cfg, home, argv, argc, page_platform);
 
-	/* Show page path only. */
+	/* Show page path only. Embedded pages have none on disk. */
 	if (target_flag == 1) {
-		char *path = find_page(cfg, page_name, page_platform);
-		if (path == NULL)
-			errx(1, "not found");
+#ifndef EMBED_PAGES
 		puts(path);
+#else
+		printf("%s (embedded)\n", path + strlen(home) + 1);
+#endif /* EMBED_PAGES */
+		free(path);
+		destroy_cfg(cfg);
 		return 0;
 	}
 
 	/* Show page. */
-	run_display(cfg, page_name, page_platform);
+	run_display(cfg, path);
+	free(path);
+
+	/* Stale pages are refreshed after the fact, in the background. */
+	if (AUTO_UPDATE_AGE > 0)
+		refresh_pages(cfg, AUTO_UPDATE_AGE);
 
+	destroy_cfg(cfg);
 	return 0;
 }
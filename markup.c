@@ -0,0 +1,186 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* Page markup scanner. Most bytes of a page are plain text, so the vector
+ * paths compare a whole block against the four interesting bytes at once
+ * and only look closer at the bits that are set. Both paths classify hits
+ * with the same function, which keeps their output identical. */
+
+/* Includes */
+#include <stdint.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_AVX2_TARGET
+#endif
+
+#include "markup.h"
+
+/* Function prototypes */
+static size_t classify(const char *buf, size_t len, size_t i, size_t *skip,
+                       Mark *out);
+static size_t scan_tail(const char *buf, size_t len, size_t *i, size_t *skip,
+                        Mark *out, size_t max);
+static size_t scan_scalar(const char *buf, size_t len, size_t *pos, Mark *out,
+                          size_t max);
+#if defined(__SSE2__)
+static size_t scan_sse2(const char *buf, size_t len, size_t *pos, Mark *out,
+                        size_t max);
+#endif
+#if defined(HAVE_AVX2_TARGET)
+static size_t scan_avx2(const char *buf, size_t len, size_t *pos, Mark *out,
+                        size_t max);
+#endif
+
+size_t
+classify(const char *buf, size_t len, size_t i, size_t *skip, Mark *out)
+{
+	if (i < *skip)
+		return 0; /* Second byte of a pair. */
+	switch (buf[i]) {
+	case '\n':
+		out->kind = MARK_NEWLINE;
+		break;
+	case '`':
+		out->kind = MARK_BACKTICK;
+		break;
+	case '{':
+	case '}':
+		if (i + 1 >= len || buf[i + 1] != buf[i])
+			return 0;
+		out->kind = (buf[i] == '{') ? MARK_OPEN : MARK_CLOSE;
+		*skip = i + 2;
+		break;
+	default:
+		return 0;
+	}
+	out->pos = i;
+	return 1;
+}
+
+size_t
+scan_tail(const char *buf, size_t len, size_t *i, size_t *skip, Mark *out,
+          size_t max)
+{
+	size_t n = 0;
+
+	for (; *i < len && n < max; (*i)++)
+		n += classify(buf, len, *i, skip, out + n);
+	return n;
+}
+
+size_t
+scan_scalar(const char *buf, size_t len, size_t *pos, Mark *out, size_t max)
+{
+	size_t i = *pos, skip = *pos, n;
+
+	n = scan_tail(buf, len, &i, &skip, out, max);
+	*pos = (skip > i) ? skip : i;
+	return n;
+}
+
+#if defined(__SSE2__)
+size_t
+scan_sse2(const char *buf, size_t len, size_t *pos, Mark *out, size_t max)
+{
+	const __m128i nl = _mm_set1_epi8('\n'), bt = _mm_set1_epi8('`');
+	const __m128i lb = _mm_set1_epi8('{'), rb = _mm_set1_epi8('}');
+	__m128i v, hit;
+	uint32_t bits;
+	size_t i, n = 0, skip = *pos;
+
+	/* A block holds at most as many marks as bytes. */
+	for (i = *pos; i + 16 <= len && n + 16 <= max; i += 16) {
+		v = _mm_loadu_si128((const __m128i *)(buf + i));
+		hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, nl),
+		                                _mm_cmpeq_epi8(v, bt)),
+		                   _mm_or_si128(_mm_cmpeq_epi8(v, lb),
+		                                _mm_cmpeq_epi8(v, rb)));
+		for (bits = (uint32_t)_mm_movemask_epi8(hit); bits != 0; bits &= bits - 1)
+			n += classify(buf, len, i + __builtin_ctz(bits), &skip, out + n);
+	}
+	if (i + 16 > len) /* Not out of room yet. */
+		n += scan_tail(buf, len, &i, &skip, out + n, max - n);
+	/* Carry on past the second byte of a pair found last. */
+	*pos = (skip > i) ? skip : i;
+	return n;
+}
+#endif
+
+#if defined(HAVE_AVX2_TARGET)
+__attribute__((target("avx2")))
+size_t
+scan_avx2(const char *buf, size_t len, size_t *pos, Mark *out, size_t max)
+{
+	const __m256i nl = _mm256_set1_epi8('\n'), bt = _mm256_set1_epi8('`');
+	const __m256i lb = _mm256_set1_epi8('{'), rb = _mm256_set1_epi8('}');
+	__m256i v, hit;
+	uint32_t bits;
+	size_t i, n = 0, skip = *pos;
+
+	/* A block holds at most as many marks as bytes. */
+	for (i = *pos; i + 32 <= len && n + 32 <= max; i += 32) {
+		v = _mm256_loadu_si256((const __m256i *)(buf + i));
+		hit = _mm256_or_si256(_mm256_or_si256(_mm256_cmpeq_epi8(v, nl),
+		                                      _mm256_cmpeq_epi8(v, bt)),
+		                      _mm256_or_si256(_mm256_cmpeq_epi8(v, lb),
+		                                      _mm256_cmpeq_epi8(v, rb)));
+		for (bits = (uint32_t)_mm256_movemask_epi8(hit); bits != 0; bits &= bits - 1)
+			n += classify(buf, len, i + __builtin_ctz(bits), &skip, out + n);
+	}
+	if (i + 32 > len) /* Not out of room yet. */
+		n += scan_tail(buf, len, &i, &skip, out + n, max - n);
+	/* Carry on past the second byte of a pair found last. */
+	*pos = (skip > i) ? skip : i;
+	return n;
+}
+#endif
+
+size_t
+markup_scan(const char *buf, size_t len, Mark *out)
+{
+	size_t pos = 0;
+
+	/* No more marks than bytes, so one call always finishes. */
+	return markup_scan_from(buf, len, &pos, out, len);
+}
+
+size_t
+markup_scan_from(const char *buf, size_t len, size_t *pos, Mark *out,
+                 size_t max)
+{
+#if defined(HAVE_AVX2_TARGET)
+	/* A load of a flag the runtime filled in at startup. */
+	if (__builtin_cpu_supports("avx2"))
+		return scan_avx2(buf, len, pos, out, max);
+#endif
+#if defined(__SSE2__)
+	return scan_sse2(buf, len, pos, out, max);
+#else
+	return scan_scalar(buf, len, pos, out, max);
+#endif
+}
+
+size_t
+markup_scan_path(int path, const char *buf, size_t len, size_t *pos,
+                 Mark *out, size_t max)
+{
+	switch (path) {
+	case SCAN_SCALAR:
+		return scan_scalar(buf, len, pos, out, max);
+#if defined(__SSE2__)
+	case SCAN_SSE2:
+		return scan_sse2(buf, len, pos, out, max);
+#endif
+#if defined(HAVE_AVX2_TARGET)
+	case SCAN_AVX2:
+		if (__builtin_cpu_supports("avx2"))
+			return scan_avx2(buf, len, pos, out, max);
+		break;
+#endif
+	}
+	return (size_t)-1;
+}
@@ -0,0 +1,37 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+#ifndef MARKUP_H
+#define MARKUP_H
+
+#include <stddef.h>
+
+#define MARKUP_MIN 32 /* Least room markup_scan_from() takes, in marks. */
+
+/* What markup_scan() found. */
+enum { MARK_NEWLINE, MARK_BACKTICK, MARK_OPEN, MARK_CLOSE };
+
+/* Ways markup_scan_path() can scan. */
+enum { SCAN_SCALAR, SCAN_SSE2, SCAN_AVX2 };
+
+typedef struct {
+	size_t pos;     /* Offset of the newline, backtick, "{{" or "}}". */
+	int kind;       /* MARK_* */
+} Mark;
+
+/* Store every newline, backtick, "{{" and "}}" in buf in out, in order, and
+ * return how many there are; out needs room for len of them. Brace pairs
+ * do not overlap: "{{{" is one MARK_OPEN at its first byte. Uses SSE2 or
+ * AVX2 when the CPU has them. */
+size_t markup_scan(const char *buf, size_t len, Mark *out);
+/* Same, from *pos and into room for max marks, at least MARKUP_MIN. Stops
+ * early when out may not hold the next block, and sets *pos to where the
+ * next call carries on; the scan is done when *pos is len. */
+size_t markup_scan_from(const char *buf, size_t len, size_t *pos, Mark *out,
+                        size_t max);
+/* markup_scan_from() the given way regardless of what it would pick, so
+ * every way can be tested against SCAN_SCALAR, a byte at a time. Returns
+ * (size_t)-1 if this build or CPU cannot scan that way. */
+size_t markup_scan_path(int path, const char *buf, size_t len, size_t *pos,
+                        Mark *out, size_t max);
+
+#endif /* MARKUP_H */
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_SIZE 32                     /* Digest length in bytes. */
+#define SHA256_HEX_SIZE (SHA256_SIZE*2 + 1) /* Hex digest plus \0. */
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t len;  /* Total bytes hashed so far. */
+	unsigned char buf[64];
+	size_t buf_len;
+} Sha256;
+
+/* Start a new digest. */
+void sha256_init(Sha256 *ctx);
+/* Feed more bytes into the digest. */
+void sha256_update(Sha256 *ctx, const void *data, size_t len);
+/* Finish the digest and write it as lowercase hex. */
+void sha256_hex(Sha256 *ctx, char hex[SHA256_HEX_SIZE]);
+
+#endif /* SHA256_H */
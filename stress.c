@@ -0,0 +1,372 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* Reader/updater stress harness. Builds two generations of a synthetic
+ * pages archive, installs one, then has reader threads look up and render
+ * random pages while an updater keeps installing the other generation over
+ * them through file:// URLs. Every render must match one generation byte
+ * for byte; anything else is a torn page. Reports read latency percentiles,
+ * update times and every lookup miss, failed render and torn page, and
+ * exits non-zero if there were any, unless -k only asks for the report. */
+
+#define _XOPEN_SOURCE 700 /* nftw() */
+
+/* Includes */
+#include <err.h>
+#include <errno.h>
+#include <ftw.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <archive.h>
+#include <archive_entry.h>
+
+#include "tldr.h"
+
+/* Constants and Macros */
+#define MKTEMP_TEMPLATE "/tmp/tinytldr_stress_XXXXXX"
+#define NGENS 2
+#define STEPS 8              /* Examples per page. */
+#define MAX_READERS 256
+#define DEFAULT_PAGES 2000
+#define DEFAULT_READERS 8
+#define DEFAULT_SECONDS 10
+#define DEFAULT_PAUSE_MS 100 /* Between updates. */
+
+/* Typedefs */
+typedef struct {
+	unsigned seed;
+	long long *lat;          /* Nanoseconds per read. */
+	size_t nlat, cap;
+	unsigned long missing;   /* find_page() came back empty. */
+	unsigned long failed;    /* show_page() failed. */
+	unsigned long torn;      /* Rendered neither generation. */
+	pthread_t thread;
+} Reader;
+
+typedef struct {
+	unsigned long runs, failed;
+	long long total, max;    /* Nanoseconds. */
+	pthread_t thread;
+} Updater;
+
+/* Function prototypes */
+static long long now_ns(void);
+static char *page_text(int page, int gen, size_t *len);
+static void write_archive(const char *path, int gen);
+static Config *new_cfg(const char *url, FILE *out);
+static void *reader(void *arg);
+static void *updater(void *arg);
+static int ll_cmp(const void *a, const void *b);
+static int remove_ent(const char *path, const struct stat *st, int type,
+                      struct FTW *ftw);
+static void usage(void);
+
+static char base[] = MKTEMP_TEMPLATE; /* Archives, pages and sidecars. */
+static char home[PATH_MAX];
+static char urls[NGENS][PATH_MAX + 8];
+static char **texts[NGENS];  /* Expected page bodies, per generation. */
+static size_t *lens[NGENS];
+static int npages = DEFAULT_PAGES;
+static long pause_ms = DEFAULT_PAUSE_MS;
+static int stop;             /* Only touched with __atomic builtins. */
+
+long long
+now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+char *
+page_text(int page, int gen, size_t *len)
+{
+	char *buf = NULL;
+	size_t size = 0;
+	FILE *f;
+	int i;
+
+	/* Generations differ on every line, so a mix of two shows. */
+	if ((f = open_memstream(&buf, &size)) == NULL)
+		err(1, "open_memstream");
+	fprintf(f, "# p%d\n\n> Stress page %d, generation %d.\n\n", page, page, gen);
+	for (i = 0; i < STEPS; i++)
+		fprintf(f, "- Step %d of generation %d:\n\n`p%d --gen %d {{step%d}}`\n\n",
+		        i, gen, page, gen, i);
+	fprintf(f, "- End of generation %d.\n", gen);
+	if (fclose(f) == EOF)
+		err(1, "open_memstream");
+	*len = size;
+	return buf;
+}
+
+void
+write_archive(const char *path, int gen)
+{
+	const char *platforms[] = {"common", "linux", "osx", "windows"};
+	char name[64];
+	struct archive_entry *e;
+	struct archive *a;
+	int i;
+
+	if ((a = archive_write_new()) == NULL ||
+	    archive_write_set_format_zip(a) != ARCHIVE_OK ||
+	    archive_write_open_filename(a, path) != ARCHIVE_OK)
+		errx(1, "unable to create %s", path);
+	for (i = 0; i < npages; i++) {
+		snprintf(name, sizeof(name), "%s/p%d.md", platforms[i % 4], i);
+		if ((e = archive_entry_new()) == NULL)
+			errx(1, "archive_entry_new failed");
+		archive_entry_set_pathname(e, name);
+		archive_entry_set_filetype(e, AE_IFREG);
+		archive_entry_set_perm(e, 0644);
+		archive_entry_set_size(e, (la_int64_t)lens[gen][i]);
+		if (archive_write_header(a, e) != ARCHIVE_OK ||
+		    archive_write_data(a, texts[gen][i], lens[gen][i]) !=
+		    (la_ssize_t)lens[gen][i])
+			errx(1, "%s: %s", path, archive_error_string(a));
+		archive_entry_free(e);
+	}
+	if (archive_write_close(a) != ARCHIVE_OK)
+		errx(1, "%s: %s", path, archive_error_string(a));
+	archive_write_free(a);
+}
+
+Config *
+new_cfg(const char *url, FILE *out)
+{
+	Config *cfg;
+
+	/* Unstyled, so a render is the page itself. */
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = url,
+		.pages_home    = home,
+		.user_agent    = "tinytldr-stress",
+		.heading_style = "",
+		.summary_style = "",
+		.comment_style = "",
+		.command_style = "",
+		.reset_style   = "",
+		.skip_empty    = 0,
+		.apply_styles  = 0,
+		.out           = out,
+	});
+	if (cfg == NULL)
+		errx(1, "unable to allocate config");
+	return cfg;
+}
+
+void *
+reader(void *arg)
+{
+	Reader *r = arg;
+	char name[32], *path, *buf;
+	size_t size, g;
+	long long start, *tmp;
+	Config *cfg;
+	FILE *out;
+	int page, ok;
+
+	while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+		page = rand_r(&r->seed) % npages;
+		snprintf(name, sizeof(name), "p%d.md", page);
+		buf = NULL;
+		if ((out = open_memstream(&buf, &size)) == NULL)
+			err(1, "open_memstream");
+		cfg = new_cfg(urls[0], out);
+
+		/* Time what a user waits for: the lookup and the render. */
+		start = now_ns();
+		ok = -1;
+		if ((path = find_page(cfg, name, NULL)) == NULL)
+			r->missing++;
+		else if ((ok = show_page(cfg, path)) == -1)
+			r->failed++;
+		if (fclose(out) == EOF)
+			err(1, "open_memstream");
+		if (ok == 0) {
+			for (g = 0; g < NGENS; g++)
+				if (size == lens[g][page] &&
+				    memcmp(buf, texts[g][page], size) == 0)
+					break;
+			r->torn += (g == NGENS);
+		}
+		if (r->nlat == r->cap) {
+			r->cap = r->cap ? r->cap * 2 : 4096;
+			if ((tmp = realloc(r->lat, r->cap * sizeof(*tmp))) == NULL)
+				err(1, "realloc");
+			r->lat = tmp;
+		}
+		r->lat[r->nlat++] = now_ns() - start;
+
+		free(path);
+		free(buf);
+		destroy_cfg(cfg);
+	}
+	return NULL;
+}
+
+void *
+updater(void *arg)
+{
+	Updater *u = arg;
+	Config *cfg[NGENS];
+	struct timespec ts;
+	long long start, took;
+	int g;
+
+	for (g = 0; g < NGENS; g++)
+		cfg[g] = new_cfg(urls[g], NULL);
+	/* Generation 0 is installed; alternate from 1. */
+	for (g = 1; !__atomic_load_n(&stop, __ATOMIC_RELAXED);
+	     g = (g + 1) % NGENS) {
+		start = now_ns();
+		if (update_pages(cfg[g], NULL) == -1)
+			u->failed++;
+		took = now_ns() - start;
+		u->runs++;
+		u->total += took;
+		if (took > u->max)
+			u->max = took;
+		ts.tv_sec = pause_ms / 1000;
+		ts.tv_nsec = (pause_ms % 1000) * 1000000;
+		nanosleep(&ts, NULL);
+	}
+	for (g = 0; g < NGENS; g++)
+		destroy_cfg(cfg[g]);
+	return NULL;
+}
+
+int
+ll_cmp(const void *a, const void *b)
+{
+	long long x = *(const long long *)a, y = *(const long long *)b;
+
+	return (x > y) - (x < y);
+}
+
+int
+remove_ent(const char *path, const struct stat *st, int type, struct FTW *ftw)
+{
+	(void)st;
+	(void)type;
+	(void)ftw;
+	if (remove(path) == -1)
+		warn("unable to remove %s", path);
+	return 0;
+}
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: tldr-stress [-k] [-d SECONDS] [-n PAGES] "
+	        "[-p PAUSE_MS] [-r READERS]\n");
+	exit(1);
+}
+
+int
+main(int argc, char *argv[])
+{
+	Reader readers[MAX_READERS] = {{0}};
+	Updater upd = {0};
+	char path[PATH_MAX];
+	long long *lat;
+	unsigned long missing = 0, failed = 0, torn = 0;
+	size_t n = 0, i, j;
+	long seconds = DEFAULT_SECONDS;
+	int nreaders = DEFAULT_READERS, report_only = 0, opt, g;
+	Config *cfg;
+	char *end;
+
+	while ((opt = getopt(argc, argv, "d:kn:p:r:")) != -1) {
+		errno = 0;
+		switch (opt) {
+		case 'k': report_only = 1; continue; /* No argument to check. */
+		case 'd': seconds = strtol(optarg, &end, 10); break;
+		case 'n': npages = (int)strtol(optarg, &end, 10); break;
+		case 'p': pause_ms = strtol(optarg, &end, 10); break;
+		case 'r': nreaders = (int)strtol(optarg, &end, 10); break;
+		default: usage();
+		}
+		if (*optarg == 0 || *end != 0 || errno != 0)
+			usage();
+	}
+	if (seconds <= 0 || npages <= 0 || pause_ms < 0 || nreaders <= 0 ||
+	    nreaders > MAX_READERS)
+		usage();
+
+	/* Two generations of every page, and an archive of each. */
+	if (mkdtemp(base) == NULL)
+		err(1, "mkdtemp");
+	snprintf(home, sizeof(home), "%s/pages", base);
+	for (g = 0; g < NGENS; g++) {
+		if ((texts[g] = malloc(npages * sizeof(*texts[g]))) == NULL ||
+		    (lens[g] = malloc(npages * sizeof(*lens[g]))) == NULL)
+			err(1, "malloc");
+		for (i = 0; i < (size_t)npages; i++)
+			texts[g][i] = page_text((int)i, g, &lens[g][i]);
+		snprintf(path, sizeof(path), "%s/gen%d.zip", base, g);
+		write_archive(path, g);
+		snprintf(urls[g], sizeof(urls[g]), "file://%s", path);
+	}
+	cfg = new_cfg(urls[0], NULL);
+	if (update_pages(cfg, NULL) == -1)
+		errx(1, "unable to install the first generation");
+	destroy_cfg(cfg);
+
+	for (i = 0; i < (size_t)nreaders; i++) {
+		readers[i].seed = (unsigned)(time(NULL) ^ (i * 2654435761u));
+		if (pthread_create(&readers[i].thread, NULL, reader, &readers[i]) != 0)
+			errx(1, "unable to start reader %zu", i);
+	}
+	if (pthread_create(&upd.thread, NULL, updater, &upd) != 0)
+		errx(1, "unable to start the updater");
+	sleep((unsigned)seconds);
+	__atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+	pthread_join(upd.thread, NULL);
+	for (i = 0; i < (size_t)nreaders; i++) {
+		pthread_join(readers[i].thread, NULL);
+		n += readers[i].nlat;
+		missing += readers[i].missing;
+		failed += readers[i].failed;
+		torn += readers[i].torn;
+	}
+
+	if ((lat = malloc((n ? n : 1) * sizeof(*lat))) == NULL)
+		err(1, "malloc");
+	for (i = j = 0; i < (size_t)nreaders; i++) {
+		memcpy(lat + j, readers[i].lat, readers[i].nlat * sizeof(*lat));
+		j += readers[i].nlat;
+		free(readers[i].lat);
+	}
+	qsort(lat, n, sizeof(*lat), ll_cmp);
+
+	printf("%d pages, %d readers, %ld s\n", npages, nreaders, seconds);
+	printf("updates  %lu, %lu failed, mean %lld ms, max %lld ms\n",
+	       upd.runs, upd.failed,
+	       upd.runs ? upd.total / (long long)upd.runs / 1000000 : 0,
+	       upd.max / 1000000);
+	if (n > 0)
+		printf("reads    %zu, p50 %lldus p90 %lldus p99 %lldus "
+		       "p99.9 %lldus max %lldus\n", n, lat[n / 2] / 1000,
+		       lat[n * 9 / 10] / 1000, lat[n * 99 / 100] / 1000,
+		       lat[n * 999 / 1000] / 1000, lat[n - 1] / 1000);
+	printf("missing  %lu\nfailed   %lu\ntorn     %lu\n", missing, failed, torn);
+
+	free(lat);
+	for (g = 0; g < NGENS; g++) {
+		for (i = 0; i < (size_t)npages; i++)
+			free(texts[g][i]);
+		free(texts[g]);
+		free(lens[g]);
+	}
+	nftw(base, remove_ent, 16, FTW_DEPTH | FTW_PHYS);
+	return (!report_only && missing + failed + torn + upd.failed > 0) ? 1 : 0;
+}
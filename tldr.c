@@ -3,333 +3,2430 @@
 
 /* Includes */
 #include <assert.h>
+#include <ctype.h>
 #include <dirent.h>
 #include <err.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <fnmatch.h>
-#include <fts.h>
 #include <ftw.h>
 #include <getopt.h>
 #include <limits.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
 
+#ifndef EMBED_PAGES
 #include <curl/curl.h>
 #include <archive.h>
 #include <archive_entry.h>
+#endif /* EMBED_PAGES */
 
+#ifdef EMBED_PAGES
+#include "embed.h"
+#endif /* EMBED_PAGES */
+#include "cost.h"
+#include "index.h"
+#include "markup.h"
+#include "sha256.h"
 #include "tldr.h"
+#include "usage.h"
+#include "walk.h"
 
 /* Constants and Macros */
-#define MAX_LINE_LEN 1024 /* Maximal tldr page line length. */
+#define READ_CHUNK 4096   /* Initial page buffer; most pages fit. */
+#define PAGE_MARKS 256    /* Marks scanned at a time; longer lines malloc. */
+#define MAX_READERS 64    /* Upper bound on parallel page readers. */
 #define HEADING_TOKEN '#'
 #define SUMMARY_TOKEN '>'
 #define COMMENT_TOKEN '-'
 #define COMMAND_TOKEN '`'
+#define PAGE_EXT ".md"
+#define UPDATED_SUFFIX ".updated" /* Touched after every update. */
+#define LOCK_SUFFIX ".lock"       /* Held while updating. */
+#define REFRESH_RETRY 3600        /* Seconds between refresh attempts. */
+#define MIRRORS_SUFFIX ".mirrors" /* Measured throughput of every source. */
+#define RACE_WIDTH 3      /* Sources downloading at once. */
+#define RACE_BYTES 65536  /* The first source to deliver this much wins. */
+#define RETRY_BASE 2      /* Seconds before the first retry; doubles. */
+#define RETRY_MAX 300     /* Longest pause between retries. */
+#define ZIP_TAIL 65557    /* End of central directory plus longest comment. */
+#define ZIP_EOCD_LEN 22
+#define ZIP_CDH_LEN 46    /* Central directory file header, fixed part. */
+#define ZIP_LFH_LEN 30    /* Local file header, fixed part. */
 
 /* Typedefs */
 struct Config {
 	char *pages_url;
+	char *pages_sha256;
+	char *sums_url;
+	char **mirrors;
 	char *user_agent;
 	char *pages_home;
 	char *heading_style;
 	char *summary_style;
 	char *comment_style;
 	char *command_style;
+	char *code_style;
+	char *placeholder_style;
 	char *reset_style;
+	int delta_update;
+	long max_rate;
+	long low_speed_limit;
+	long low_speed_time;
+	long timeout;
+	int retries;
+	long start_jitter;
+	long long deadline; /* now_ms() when downloads must stop; 0 for never. */
+	int track_usage;
 	int skip_empty;
 	int apply_styles;
 	FILE *out;
 };
 
+#ifndef EMBED_PAGES
+/* Where downloaded bytes go; filled in by the curl write callback. */
+typedef struct {
+	FILE *dest;
+	Sha256 sha;
+	size_t bytes;
+	size_t limit;   /* Abort past this many bytes; 0 for no limit. */
+} Sink;
+
+typedef struct Race Race;
+
+/* A place to download the archive from. */
+typedef struct {
+	const char *url;
+	CURL *handle;
+	char err[CURL_ERROR_SIZE];
+	FILE *head;     /* Bytes received before winning the race. */
+	char *head_buf;
+	size_t head_len;
+	size_t got;
+	double rate;    /* Bytes per second, if known. */
+	int known;
+	size_t order;   /* Position in the configured list. */
+	int state;      /* SOURCE_* */
+	Race *race;
+} Source;
+
+enum { SOURCE_IDLE, SOURCE_RACING, SOURCE_FAILED, SOURCE_DONE };
+
+/* Sources download into memory until one wins and streams into the sink. */
+struct Race {
+	Sink *sink;
+	Source *winner;
+};
+
+/* A file in a remote zip, as listed by its central directory. */
+typedef struct {
+	uint32_t crc;
+	uint64_t offset;    /* Local file header. */
+	uint64_t end;       /* One past the entry's data. */
+	int changed;
+} ZipEnt;
+#endif /* EMBED_PAGES */
+
+/* A page on its way from disk to the output. */
+typedef struct {
+	char *buf;      /* Rendered page. */
+	size_t len;
+	int state;      /* SLOT_* */
+} Slot;
+
+enum { SLOT_PENDING, SLOT_DONE, SLOT_FAILED };
+
+/* Shared by print_pages() and its reader threads. */
+typedef struct {
+	const Config *cfg;
+	int format;     /* EXPORT_* */
+	const char *sep; /* Written between pages. */
+	char *const *paths;
+	Slot *slots;
+	size_t n;
+	size_t next;    /* Next page to claim. */
+	size_t written; /* Pages already written out. */
+	size_t window;  /* How far readers may run ahead of the writer. */
+	pthread_mutex_t mu;
+	pthread_cond_t cv;
+} Batch;
+
 /* Function prototypes */
-static int entcmp(const FTSENT **a, const FTSENT **b);
+#ifndef EMBED_PAGES
+static size_t sink_write(char *ptr, size_t size, size_t nmemb, void *userdata);
+static long long now_ms(void);
+static void sleep_ms(long long ms);
+static unsigned long random_below(unsigned long n);
+static const Config *bounded(const Config *cfg, Config *copy);
+static int set_timeout(const Config *cfg, CURL *curl_handle);
+static void set_rate(const Config *cfg, CURL *curl_handle, long ways);
+static CURL *curl_open(const Config *cfg, const char *url, char *err_buf);
+static int curl_get(const Config *cfg, CURL *curl_handle, const char *range,
+                    Sink *sink, const char *err_buf);
+static int fetch_url(const Config *cfg, const char *url, Sink *sink);
+static uint32_t le16(const unsigned char *p);
+static uint32_t le32(const unsigned char *p);
+static int crc32_file(const char *path, uint32_t *crc);
+static int zipent_cmp(const void *a, const void *b);
+static int make_parents(const char *path);
+static int lock_updates(const Config *cfg, int wait);
+static int try_update(const Config *cfg, FetchReport *rep);
+static long file_age(const char *path);
+static int is_sha256_hex(const char *s);
+static char *published_sha256(const Config *cfg);
+static int source_cmp(const void *a, const void *b);
+static size_t load_sources(const Config *cfg, Source **srcs);
+static void save_sources(const Config *cfg, const Source *srcs, size_t n);
+static size_t source_write(char *ptr, size_t size, size_t nmemb, void *userdata);
+static int source_win(Source *src);
+static int source_start(const Config *cfg, CURLM *multi, Source *src, Race *race);
+static void source_stop(CURLM *multi, Source *src, int state);
+static int race_sources(const Config *cfg, Source *srcs, size_t n, Sink *sink);
+static void pack_pages(const Config *cfg);
+static void log_use(const Config *cfg, const char *path);
+static int prefetch(const char *path);
+static Index *open_index(const Config *cfg);
+static char *page_path(const Config *cfg, const char *rel);
+static char *read_fd(int fd, size_t *len);
+#else
+static char *embed_path(const Config *cfg, const EmbedPage *page);
+#endif /* EMBED_PAGES */
+static char *find_first(const Config *cfg, const char *const names[], int n,
+                        const char *platform, int *which);
+static size_t str_size(const char *s);
+static char *arena_copy(char **arena, const char *s);
+static char *load_page(const Config *cfg, const char *path, size_t *len);
+static void render_line(const Config *cfg, int styles, const char *buf,
+                        size_t line, size_t eol, const Mark *m,
+                        const Mark *end, FILE *out);
+static int render_page(const Config *cfg, int styles, const char *buf,
+                       size_t len, FILE *out);
+static void escape_html(const char *s, int len, FILE *out);
+static void escape_json(const char *s, size_t len, FILE *out);
+static int render_html(const char *label, const char *buf, size_t len, FILE *out);
+static int render_json(const char *label, const char *buf, size_t len, FILE *out);
+static int render_file(const Config *cfg, int format, const char *path, Slot *slot);
+static void *batch_reader(void *arg);
+static int run_batch(Batch *b);
+static int collect_pages(const Config *cfg, char ***paths, size_t *n);
+
+size_t
+str_size(const char *s)
+{
+	return s != NULL ? strlen(s) + 1 : 0;
+}
+
+char *
+arena_copy(char **arena, const char *s)
+{
+	char *copy = *arena;
+
+	if (s == NULL)
+		return NULL;
+	*arena = stpcpy(copy, s) + 1;
+	return copy;
+}
 
 Config *
 create_cfg(const ConfigOpts *opts)
 {
+	size_t size, n, i;
+	Config *cfg;
+	char *p;
+
 	assert(opts != NULL);
 
-	Config *cfg = malloc(sizeof(Config));
-	if (cfg == NULL)
+	if (opts->pages_url == NULL || opts->pages_home == NULL ||
+	    opts->heading_style == NULL || opts->summary_style == NULL ||
+	    opts->command_style == NULL || opts->comment_style == NULL ||
+	    opts->reset_style == NULL)
 		return NULL;
 
-	cfg->pages_url     = opts->pages_url     ? strdup(opts->pages_url)     : NULL;
-	cfg->user_agent    = opts->user_agent    ? strdup(opts->user_agent)    : NULL;
-	cfg->pages_home    = opts->pages_home    ? strdup(opts->pages_home)    : NULL;
-	cfg->heading_style = opts->heading_style ? strdup(opts->heading_style) : NULL;
-	cfg->summary_style = opts->summary_style ? strdup(opts->summary_style) : NULL;
-	cfg->command_style = opts->command_style ? strdup(opts->command_style) : NULL;
-	cfg->comment_style = opts->comment_style ? strdup(opts->comment_style) : NULL;
-	cfg->reset_style   = opts->reset_style   ? strdup(opts->reset_style)   : NULL;
-
-	cfg->skip_empty   = opts->skip_empty;
-	cfg->apply_styles = opts->apply_styles;
-	cfg->out          = opts->out;
-
-	if ((cfg->pages_url     == NULL) ||
-	    (cfg->pages_home    == NULL) ||
-	    (cfg->heading_style == NULL) ||
-	    (cfg->summary_style == NULL) ||
-	    (cfg->command_style == NULL) ||
-	    (cfg->comment_style == NULL) ||
-	    (cfg->reset_style   == NULL)) {
+	/* One block: the struct, the mirror list, then every string. */
+	for (n = 0; opts->mirrors != NULL && opts->mirrors[n] != NULL; n++)
+		;
+	size = sizeof(Config) + (n + 1) * sizeof(char *);
+	for (i = 0; i < n; i++)
+		size += str_size(opts->mirrors[i]);
+	size += str_size(opts->pages_url) + str_size(opts->pages_sha256) +
+	        str_size(opts->sums_url) + str_size(opts->user_agent) +
+	        str_size(opts->pages_home) + str_size(opts->heading_style) +
+	        str_size(opts->summary_style) + str_size(opts->comment_style) +
+	        str_size(opts->command_style) + str_size(opts->code_style) +
+	        str_size(opts->placeholder_style) + str_size(opts->reset_style);
+	if ((cfg = malloc(size)) == NULL)
 		return NULL;
-	}
+
+	cfg->mirrors = (char **)(cfg + 1);
+	p = (char *)(cfg->mirrors + n + 1);
+	for (i = 0; i < n; i++)
+		cfg->mirrors[i] = arena_copy(&p, opts->mirrors[i]);
+	cfg->mirrors[n] = NULL;
+	cfg->pages_url         = arena_copy(&p, opts->pages_url);
+	cfg->pages_sha256      = arena_copy(&p, opts->pages_sha256);
+	cfg->sums_url          = arena_copy(&p, opts->sums_url);
+	cfg->user_agent        = arena_copy(&p, opts->user_agent);
+	cfg->pages_home        = arena_copy(&p, opts->pages_home);
+	cfg->heading_style     = arena_copy(&p, opts->heading_style);
+	cfg->summary_style     = arena_copy(&p, opts->summary_style);
+	cfg->comment_style     = arena_copy(&p, opts->comment_style);
+	cfg->command_style     = arena_copy(&p, opts->command_style);
+	cfg->code_style        = arena_copy(&p, opts->code_style);
+	cfg->placeholder_style = arena_copy(&p, opts->placeholder_style);
+	cfg->reset_style       = arena_copy(&p, opts->reset_style);
+
+	cfg->delta_update    = opts->delta_update;
+	cfg->max_rate        = opts->max_rate;
+	cfg->low_speed_limit = opts->low_speed_limit;
+	/* A capped transfer must not count as stalled. */
+	if (cfg->max_rate > 0 && cfg->low_speed_limit >= cfg->max_rate)
+		cfg->low_speed_limit = cfg->max_rate / 2;
+	cfg->low_speed_time  = opts->low_speed_time;
+	cfg->timeout         = opts->timeout;
+	cfg->retries         = opts->retries;
+	cfg->start_jitter    = opts->start_jitter;
+	cfg->deadline        = 0;
+	cfg->track_usage     = opts->track_usage;
+	cfg->skip_empty      = opts->skip_empty;
+	cfg->apply_styles    = opts->apply_styles;
+	cfg->out             = opts->out;
 	return cfg;
 }
 
 void
 destroy_cfg(Config *cfg)
 {
-	if (cfg == NULL)
-		return;
-	free(cfg->pages_url);
-	free(cfg->pages_home);
-	free(cfg->heading_style);
-	free(cfg->summary_style);
-	free(cfg->command_style);
-	free(cfg->comment_style);
-	free(cfg->reset_style);
+	/* Strings and mirrors live in the same block. */
 	free(cfg);
 }
 
+#ifndef EMBED_PAGES
+size_t
+sink_write(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	Sink *sink = userdata;
+	size_t n = size * nmemb;
+
+	/* A server ignoring Range would send the whole archive. */
+	if (sink->limit > 0 && sink->bytes + n > sink->limit)
+		return 0;
+	/* Hash on the way through; a short write makes curl abort. */
+	if (fwrite(ptr, 1, n, sink->dest) != n)
+		return 0;
+	sha256_update(&sink->sha, ptr, n);
+	sink->bytes += n;
+	return n;
+}
+
+long long
+now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void
+sleep_ms(long long ms)
+{
+	struct timespec ts;
+
+	ts.tv_sec = ms / 1000;
+	ts.tv_nsec = (ms % 1000) * 1000000;
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+unsigned long
+random_below(unsigned long n)
+{
+	unsigned long x = (unsigned long)time(NULL) ^ (unsigned long)getpid() << 16;
+	int fd;
+
+	/* Hosts started by the same cron tick must not agree. */
+	if ((fd = open("/dev/urandom", O_RDONLY)) != -1) {
+		if (read(fd, &x, sizeof(x)) != (ssize_t)sizeof(x))
+			x ^= (unsigned long)now_ms();
+		close(fd);
+	}
+	return (n > 0) ? x % n : 0;
+}
+
+const Config *
+bounded(const Config *cfg, Config *copy)
+{
+	/* The first public entry point to see the timeout starts the clock. */
+	if (cfg->timeout <= 0 || cfg->deadline != 0)
+		return cfg;
+	*copy = *cfg;
+	copy->deadline = now_ms() + cfg->timeout * 1000;
+	return copy;
+}
+
 int
-fetch_pages(const Config *cfg, FILE *dest)
+set_timeout(const Config *cfg, CURL *curl_handle)
 {
-	CURL    *curl_handle;
-	CURLcode curl_res;                  /* Curl operation result. */
-	char     curl_err[CURL_ERROR_SIZE]; /* Curl error message buffer. */
+	long long left;
 
-	assert(dest != NULL);
-	assert(cfg != NULL);
+	if (cfg->deadline == 0)
+		return 0;
+	if ((left = cfg->deadline - now_ms()) <= 0) {
+		warnx("timed out after %ld seconds", cfg->timeout);
+		return -1;
+	}
+	curl_easy_setopt(curl_handle, CURLOPT_TIMEOUT_MS, (long)left);
+	return 0;
+}
 
-	curl_global_init(CURL_GLOBAL_ALL);
+CURL *
+curl_open(const Config *cfg, const char *url, char *err_buf)
+{
+	CURL *curl_handle;
+
+	err_buf[0] = 0;
 	curl_handle = curl_easy_init();
-	curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, curl_err);
+	if (curl_handle == NULL) {
+		warnx("curl_easy_init failed");
+		return NULL;
+	}
+	curl_easy_setopt(curl_handle, CURLOPT_ERRORBUFFER, err_buf);
 	curl_easy_setopt(curl_handle, CURLOPT_FAILONERROR, 1L);
 	curl_easy_setopt(curl_handle, CURLOPT_FOLLOWLOCATION, 1L);
 	curl_easy_setopt(curl_handle, CURLOPT_MAXREDIRS, 5L);
-	curl_easy_setopt(curl_handle, CURLOPT_URL, cfg->pages_url);
+	curl_easy_setopt(curl_handle, CURLOPT_URL, url);
 	curl_easy_setopt(curl_handle, CURLOPT_USERAGENT, cfg->user_agent);
-	curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, dest);
+	curl_easy_setopt(curl_handle, CURLOPT_WRITEFUNCTION, sink_write);
+	set_rate(cfg, curl_handle, 1);
+	return curl_handle;
+}
 
-	curl_res = curl_easy_perform(curl_handle);
+void
+set_rate(const Config *cfg, CURL *curl_handle, long ways)
+{
+	long rate = cfg->max_rate / ways, low = cfg->low_speed_limit;
 
-	curl_easy_cleanup(curl_handle);
-	curl_global_cleanup();
+	/* Share the uplink, and give up on transfers that stall; a share of
+	 * the cap must not count as a stall. */
+	if (cfg->max_rate > 0) {
+		if (rate < 1)
+			rate = 1;
+		curl_easy_setopt(curl_handle, CURLOPT_MAX_RECV_SPEED_LARGE,
+		                 (curl_off_t)rate);
+		if (low >= rate)
+			low = rate / 2;
+	}
+	if (cfg->low_speed_limit > 0 && cfg->low_speed_time > 0) {
+		curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_LIMIT, low);
+		curl_easy_setopt(curl_handle, CURLOPT_LOW_SPEED_TIME,
+		                 cfg->low_speed_time);
+	}
+}
+
+int
+curl_get(const Config *cfg, CURL *curl_handle, const char *range, Sink *sink,
+         const char *err_buf)
+{
+	CURLcode curl_res;                  /* Curl operation result. */
+	char *url = NULL;
+
+	if (set_timeout(cfg, curl_handle) == -1)
+		return -1;
+	curl_easy_setopt(curl_handle, CURLOPT_RANGE, range);
+	curl_easy_setopt(curl_handle, CURLOPT_WRITEDATA, sink);
+	curl_res = curl_easy_perform(curl_handle);
 
-	if (curl_res != CURLE_OK)
-		warnx("unable to fetch pages: %s", curl_err);
+	if (curl_res != CURLE_OK) {
+		curl_easy_getinfo(curl_handle, CURLINFO_EFFECTIVE_URL, &url);
+		warnx("unable to fetch %s: %s", url ? url : "pages",
+		      err_buf[0] ? err_buf : curl_easy_strerror(curl_res));
+	}
 	return (curl_res == CURLE_OK) ? 0 : -1;
 }
 
 int
-extract_pages(const Config *cfg, FILE *archive)
+fetch_url(const Config *cfg, const char *url, Sink *sink)
 {
-	struct archive *a = NULL;
-	struct archive *ext = NULL;
-	struct archive_entry *entry;
-	int r;
-	char *path;
-	size_t len;
-	const char *entry_path;
-
-	assert(cfg != NULL);
-	assert(archive != NULL);
+	CURL    *curl_handle;
+	char     curl_err[CURL_ERROR_SIZE]; /* Curl error message buffer. */
+	int      r;
 
-	a = archive_read_new();
-	if (a == NULL) {
-		warnx("archive_read_new failed");
+	if ((curl_handle = curl_open(cfg, url, curl_err)) == NULL)
 		return -1;
-	}
+	r = curl_get(cfg, curl_handle, NULL, sink, curl_err);
+	curl_easy_cleanup(curl_handle);
+	return r;
+}
 
-	archive_read_support_filter_all(a);
-	archive_read_support_format_all(a);
+int
+is_sha256_hex(const char *s)
+{
+	size_t i;
 
-	r = archive_read_open_FILE(a, archive);
-	if (r != ARCHIVE_OK) {
-		warnx("archive_read_open_FILE: %s", archive_error_string(a));
-		goto out;
+	for (i = 0; i < SHA256_HEX_SIZE - 1; i++)
+		if (!isxdigit((unsigned char)s[i]))
+			return 0;
+	return s[i] == 0;
+}
+
+char *
+published_sha256(const Config *cfg)
+{
+	const char *want;
+	char *buf = NULL, *line, *save, *found = NULL;
+	char hex[SHA256_HEX_SIZE], file[256];
+	size_t len = 0;
+	Sink sink = {0};
+	int r, n;
+
+	/* Download the sums file into memory. */
+	if ((sink.dest = open_memstream(&buf, &len)) == NULL) {
+		warn("open_memstream");
+		return NULL;
+	}
+	sha256_init(&sink.sha);
+	r = fetch_url(cfg, cfg->sums_url, &sink);
+	fclose(sink.dest);
+	if (r == -1) {
+		free(buf);
+		return NULL;
 	}
 
-	ext = archive_write_disk_new();
-	if (ext == NULL) {
-		warnx("archive_write_disk_new failed");
-		r = ARCHIVE_FATAL;
-		goto out;
+	/* Look for a "<hex>  [*]<file>" line naming our archive. */
+	want = strrchr(cfg->pages_url, '/');
+	want = (want != NULL) ? want + 1 : cfg->pages_url;
+	for (line = strtok_r(buf, "\n", &save); line != NULL;
+	     line = strtok_r(NULL, "\n", &save)) {
+		/* A malformed digest is as good as none. */
+		if (sscanf(line, "%64s%n %255s", hex, &n, file) != 2 ||
+		    !isspace((unsigned char)line[n]) || !is_sha256_hex(hex))
+			continue;
+		if (strcmp(file[0] == '*' ? file + 1 : file, want) == 0) {
+			found = strdup(hex);
+			break;
+		}
 	}
+	if (found == NULL)
+		warnx("no checksum for %s in %s", want, cfg->sums_url);
 
-	archive_write_disk_set_options(ext, 0);
+	free(buf);
+	return found;
+}
 
-	while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
-		entry_path = archive_entry_pathname(entry);
-		if (entry_path == NULL)
-			entry_path = "";
+int
+source_cmp(const void *a, const void *b)
+{
+	const Source *x = a, *y = b;
 
-		/* +2 for / and \0 */
-		len = strlen(cfg->pages_home) + strlen(entry_path) + 2;
-		if ((path = malloc(len)) == NULL) {
-			warn("malloc");
-			r = ARCHIVE_FATAL;
-			goto out;
-		}
-		snprintf(path, len, "%s/%s", cfg->pages_home, entry_path);
+	/* Untried sources first, to measure them; then the fastest. */
+	if (x->known != y->known)
+		return x->known - y->known;
+	if (x->known && x->rate != y->rate)
+		return (x->rate < y->rate) ? 1 : -1;
+	return (x->order > y->order) - (x->order < y->order);
+}
 
-		archive_entry_set_pathname(entry, path);
-		free(path);
+size_t
+load_sources(const Config *cfg, Source **srcs)
+{
+	char path[PATH_MAX];
+	char *line = NULL, *url;
+	size_t n, i, size = 0;
+	double rate;
+	FILE *f;
 
-		r = archive_read_extract2(a, entry, ext);
-		if (r != ARCHIVE_OK) {
-			warnx("archive_read_extract2: %s", archive_error_string(a));
-			goto out;
+	/* Mirrors in the configured order, then the upstream archive. */
+	for (n = 0; cfg->mirrors[n] != NULL; n++)
+		;
+	if ((*srcs = calloc(n + 1, sizeof(Source))) == NULL) {
+		warn("calloc");
+		return 0;
+	}
+	for (i = 0; i <= n; i++) {
+		(*srcs)[i].url = (i < n) ? cfg->mirrors[i] : cfg->pages_url;
+		(*srcs)[i].order = i;
+	}
+	if (n == 0)
+		return 1; /* Nothing to rank. */
+
+	/* "<bytes per second> <url>" lines from earlier downloads. */
+	if (sidecar_path(path, sizeof(path), cfg->pages_home, MIRRORS_SUFFIX) == 0 &&
+	    (f = fopen(path, "r")) != NULL) {
+		while (getline(&line, &size, f) != -1) {
+			rate = strtod(line, &url);
+			url += strspn(url, " ");
+			url[strcspn(url, "\n")] = 0;
+			for (i = 0; i <= n; i++) {
+				if (strcmp((*srcs)[i].url, url) == 0) {
+					(*srcs)[i].rate = rate;
+					(*srcs)[i].known = 1;
+				}
+			}
 		}
+		free(line);
+		fclose(f);
 	}
+	qsort(*srcs, n + 1, sizeof(Source), source_cmp);
+	return n + 1;
+}
 
-	if (r != ARCHIVE_EOF)
-		warnx("archive_read_next_header: %s", archive_error_string(a));
+void
+save_sources(const Config *cfg, const Source *srcs, size_t n)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 8];
+	size_t i;
+	FILE *f;
+	int fd;
 
-out:
-	archive_write_free(ext);
-	archive_read_close(a);
-	archive_read_free(a);
+	if (sidecar_path(path, sizeof(path), cfg->pages_home, MIRRORS_SUFFIX) == -1)
+		return;
+	snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+	if ((fd = mkstemp(tmp)) == -1)
+		return; /* Only a hint for next time. */
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		unlink(tmp);
+		return;
+	}
+	for (i = 0; i < n; i++)
+		if (srcs[i].known)
+			fprintf(f, "%.0f %s\n", srcs[i].rate, srcs[i].url);
+	if (fchmod(fd, 0644) == -1 || fclose(f) == EOF || rename(tmp, path) == -1)
+		unlink(tmp);
+}
 
-	return (r == ARCHIVE_EOF) ? 0 : -1;
+size_t
+source_write(char *ptr, size_t size, size_t nmemb, void *userdata)
+{
+	Source *src = userdata;
+	size_t n = size * nmemb;
+
+	if (src->race->winner == src)
+		return sink_write(ptr, size, nmemb, src->race->sink);
+	if (src->race->winner != NULL)
+		return 0; /* Lost; abort. */
+	if (fwrite(ptr, 1, n, src->head) != n)
+		return 0;
+	src->got += n;
+	if (src->got >= RACE_BYTES && source_win(src) == -1)
+		return 0;
+	return n;
+}
+
+int
+source_win(Source *src)
+{
+	size_t n;
+
+	/* Hand over what was buffered; the rest streams straight through. */
+	src->race->winner = src;
+	if (fclose(src->head) == EOF) {
+		src->head = NULL;
+		return -1;
+	}
+	src->head = NULL;
+	n = sink_write(src->head_buf, 1, src->head_len, src->race->sink);
+	free(src->head_buf);
+	src->head_buf = NULL;
+	return (n == src->head_len) ? 0 : -1;
 }
 
 int
-entcmp(const FTSENT **a, const FTSENT **b)
+source_start(const Config *cfg, CURLM *multi, Source *src, Race *race)
 {
-	return strcmp((*a)->fts_name, (*b)->fts_name);
+	src->state = SOURCE_FAILED;
+	if ((src->handle = curl_open(cfg, src->url, src->err)) == NULL)
+		return -1;
+	if (set_timeout(cfg, src->handle) == -1) {
+		curl_easy_cleanup(src->handle);
+		return -1;
+	}
+	/* Racers split the rate cap, so the race stays within it. */
+	set_rate(cfg, src->handle, RACE_WIDTH);
+	if ((src->head = open_memstream(&src->head_buf, &src->head_len)) == NULL) {
+		curl_easy_cleanup(src->handle);
+		return -1;
+	}
+	curl_easy_setopt(src->handle, CURLOPT_WRITEFUNCTION, source_write);
+	curl_easy_setopt(src->handle, CURLOPT_WRITEDATA, src);
+	curl_easy_setopt(src->handle, CURLOPT_PRIVATE, src);
+	src->race = race;
+	src->got = 0;
+	if (curl_multi_add_handle(multi, src->handle) != CURLM_OK) {
+		source_stop(multi, src, SOURCE_FAILED);
+		return -1;
+	}
+	src->state = SOURCE_RACING;
+	return 0;
 }
 
-char *
-find_page(const Config *cfg, const char *name, const char *platform)
+void
+source_stop(CURLM *multi, Source *src, int state)
 {
-	char *path_argv[] = {cfg->pages_home, NULL};
-	char *found = NULL;
-	FTS *tree;
-	FTSENT *f;
+	curl_off_t speed = 0;
 
-	assert(cfg != NULL);
-	assert(name != NULL);
+	/* A failed source goes last next time, until it proves itself again.
+	 * One stopped before sending anything tells us nothing. */
+	if (state != SOURCE_IDLE || src->got > 0) {
+		if (state != SOURCE_FAILED)
+			curl_easy_getinfo(src->handle, CURLINFO_SPEED_DOWNLOAD_T, &speed);
+		src->rate = (double)speed;
+		src->known = 1;
+	}
+	src->state = state;
 
-	tree = fts_open(path_argv, FTS_LOGICAL|FTS_NOSTAT, entcmp);
-	if (tree == NULL) {
-		warn("fts_open");
-		return NULL;
+	curl_multi_remove_handle(multi, src->handle);
+	curl_easy_cleanup(src->handle);
+	src->handle = NULL;
+	if (src->head != NULL)
+		fclose(src->head);
+	src->head = NULL;
+	free(src->head_buf);
+	src->head_buf = NULL;
+}
+
+int
+race_sources(const Config *cfg, Source *srcs, size_t n, Sink *sink)
+{
+	Race race = {sink, NULL};
+	CURLM *multi;
+	CURLMsg *msg;
+	Source *src;
+	char *priv;
+	off_t start;
+	size_t racing, i;
+	int running, left, restarted = 0, lifted = 0, r = -1;
+
+	if ((multi = curl_multi_init()) == NULL) {
+		warnx("curl_multi_init failed");
+		return -1;
 	}
+	start = ftello(sink->dest);
 
-	while ((f = fts_read(tree))) {
-		if (f->fts_info != FTS_F)
-			continue; /* Not a file. */
+	for (;;) {
+		/* Keep the first few healthy sources going until one wins. */
+		for (racing = 0, i = 0; i < n; i++)
+			racing += srcs[i].state == SOURCE_RACING;
+		for (i = 0; i < n && race.winner == NULL && racing < RACE_WIDTH; i++)
+			if (srcs[i].state == SOURCE_IDLE &&
+			    source_start(cfg, multi, &srcs[i], &race) == 0)
+				racing++;
+		if (racing == 0)
+			break; /* Every source failed. */
 
-		if (strcmp(f->fts_name, name) == 0) {
-			/* Only name match. */
-			if (platform == NULL) {
-				found = f->fts_path;
-				break;
+		curl_multi_perform(multi, &running);
+		while ((msg = curl_multi_info_read(multi, &left)) != NULL) {
+			if (msg->msg != CURLMSG_DONE)
+				continue;
+			curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, &priv);
+			src = (Source *)priv;
+			if (race.winner != NULL && race.winner != src) {
+				source_stop(multi, src, SOURCE_IDLE); /* Lost. */
+				continue;
 			}
-			/* Both name and platform match. */
-			if (strcmp(f->fts_parent->fts_name, platform) == 0) {
-				found = f->fts_path;
-				break;
+			if (msg->data.result == CURLE_OK &&
+			    (race.winner == src || source_win(src) == 0)) {
+				source_stop(multi, src, SOURCE_DONE);
+				r = 0;
+				goto out;
 			}
+			warnx("unable to fetch %s: %s", src->url, src->err[0] ?
+			      src->err : curl_easy_strerror(msg->data.result));
+			if (race.winner == src) {
+				/* Start over from the remaining sources. */
+				if (start == -1 || fseeko(sink->dest, start, SEEK_SET) == -1)
+					goto out;
+				sink->bytes = 0;
+				sha256_init(&sink->sha);
+				race.winner = NULL;
+				restarted = 1;
+				lifted = 0;
+			}
+			source_stop(multi, src, SOURCE_FAILED);
 		}
-	}
 
-	if (found != NULL)
-		found = strdup(found);
+		/* The winner streams on its own, at the whole rate cap; stop
+		 * the others. Not from a callback: curl forbids setopt there. */
+		for (i = 0; race.winner != NULL && i < n; i++)
+			if (srcs[i].state == SOURCE_RACING && race.winner != &srcs[i])
+				source_stop(multi, &srcs[i], SOURCE_IDLE);
+		if (race.winner != NULL && !lifted) {
+			set_rate(cfg, race.winner->handle, 1);
+			lifted = 1;
+		}
+		if (running > 0)
+			curl_multi_poll(multi, NULL, 0, 1000, NULL);
+	}
 
-	fts_close(tree);
-	return found;
+out:
+	for (i = 0; i < n; i++)
+		if (srcs[i].state == SOURCE_RACING)
+			source_stop(multi, &srcs[i], SOURCE_IDLE);
+	curl_multi_cleanup(multi);
+	/* A shorter second attempt must not leave the first one's tail. */
+	if (r == 0 && restarted && fflush(sink->dest) == 0 &&
+	    fileno(sink->dest) != -1 &&
+	    ftruncate(fileno(sink->dest), ftello(sink->dest)) == -1)
+		r = -1;
+	return r;
 }
 
 int
-print_page(const Config *cfg, FILE *page)
+fetch_pages(const Config *cfg, FILE *dest, FetchReport *report)
 {
-	char line[MAX_LINE_LEN];
-	char *n_ptr;
-	char *style = NULL;
-	int n;
+	FetchReport rep = {0};
+	Sink sink = {0};
+	Source *srcs = NULL;
+	Config copy;
+	char *expected = NULL;
+	size_t n;
+	int r = -1;
 
+	assert(dest != NULL);
 	assert(cfg != NULL);
-	assert(page != NULL);
 
-	while (fgets(line, MAX_LINE_LEN, page) != NULL) {
-		/* Skip empty lines if needed. */
-		if (cfg->skip_empty && line[0] == '\n')
-			continue;
+	cfg = bounded(cfg, &copy);
 
-		/* Discard end-of-line character. */
-		n_ptr = strstr(line, "\n");
-		if (n_ptr != NULL)
-			*n_ptr = 0;
-
-		/* Choose styling if needed. */
-		if (cfg->apply_styles == 1) {
-			switch (line[0]) {
-			case HEADING_TOKEN:
-				style = cfg->heading_style;
-				break;
-			case SUMMARY_TOKEN:
-				style = cfg->summary_style;
-				break;
-			case COMMENT_TOKEN:
-				style = cfg->comment_style;
-				break;
-			case COMMAND_TOKEN:
-				style = cfg->command_style;
-				break;
-			default:
-				style = NULL;
-			}
-		}
+	curl_global_init(CURL_GLOBAL_ALL);
 
-		/* Print page. */
-		if (style != NULL) {
-			n = fprintf(cfg->out, "%s%s%s\n", style, line, cfg->reset_style);
-		} else {
-			n = fprintf(cfg->out, "%s\n", line);
+	/* A configured checksum wins over the published one. Once either is
+	 * configured, an archive that cannot be checked is not taken. */
+	if (cfg->pages_sha256 != NULL)
+		expected = strdup(cfg->pages_sha256);
+	else if (cfg->sums_url != NULL)
+		expected = published_sha256(cfg);
+	if (expected == NULL &&
+	    (cfg->pages_sha256 != NULL || cfg->sums_url != NULL)) {
+		warnx("no checksum to verify %s against", cfg->pages_url);
+		curl_global_cleanup();
+		if (report != NULL)
+			*report = rep;
+		return -1;
+	}
+
+	/* Race the best known sources; fall back to the rest. */
+	sink.dest = dest;
+	sha256_init(&sink.sha);
+	if ((n = load_sources(cfg, &srcs)) > 0) {
+		r = race_sources(cfg, srcs, n, &sink);
+		if (n > 1)
+			save_sources(cfg, srcs, n);
+	}
+	free(srcs);
+	if (r == 0 && fflush(dest) == EOF) {
+		warn("unable to write pages");
+		r = -1;
+	}
+
+	rep.bytes = sink.bytes;
+	sha256_hex(&sink.sha, rep.sha256);
+	if (r == 0 && expected != NULL) {
+		rep.verified = strcasecmp(expected, rep.sha256) == 0;
+		if (!rep.verified) {
+			warnx("checksum mismatch: expected %s, got %s",
+			      expected, rep.sha256);
+			r = -1;
 		}
+	}
 
-		if (n < 0) {
-			warn("unable to print page");
-			return -1;
+	curl_global_cleanup();
+	free(expected);
+	if (report != NULL)
+		*report = rep;
+	return r;
+}
+
+uint32_t
+le16(const unsigned char *p)
+{
+	return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+uint32_t
+le32(const unsigned char *p)
+{
+	return le16(p) | le16(p + 2) << 16;
+}
+
+int
+crc32_file(const char *path, uint32_t *crc)
+{
+	static uint32_t table[256];
+	unsigned char buf[READ_CHUNK];
+	uint32_t c;
+	ssize_t n, i;
+	int fd, k;
+
+	if (table[1] == 0) {
+		for (i = 0; i < 256; i++) {
+			for (c = (uint32_t)i, k = 0; k < 8; k++)
+				c = (c & 1) ? 0xedb88320 ^ (c >> 1) : c >> 1;
+			table[i] = c;
 		}
 	}
-	return 0;
+
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	c = 0xffffffff;
+	while ((n = read(fd, buf, sizeof(buf))) > 0)
+		for (i = 0; i < n; i++)
+			c = table[(c ^ buf[i]) & 0xff] ^ (c >> 8);
+	close(fd);
+	*crc = c ^ 0xffffffff;
+	return (n == 0) ? 0 : -1;
 }
 
 int
-list_pages(const Config *cfg)
+zipent_cmp(const void *a, const void *b)
 {
-	const char *pattern = "*.md";
-	char *path_argv[] = {cfg->pages_home, NULL};
-	FTS *tree;
-	FTSENT *f;
+	const ZipEnt *x = a, *y = b;
+
+	return (x->offset > y->offset) - (x->offset < y->offset);
+}
+
+int
+fetch_changed(const Config *cfg, FILE *dest, FetchReport *report)
+{
+	static const unsigned char eocd_sig[] = {'P', 'K', 5, 6};
+	FetchReport rep = {0};
+	CURL *curl_handle = NULL;
+	char curl_err[CURL_ERROR_SIZE];
+	char range[64], path[PATH_MAX];
+	char *tail = NULL, *cd = NULL;
+	size_t tail_len = 0, cd_len = 0, nents = 0, nsrcs, i, j, name_len, off;
+	unsigned char *p, *eocd = NULL;
+	uint64_t cd_off, cd_size;
+	uint32_t crc, nrecs;
+	curl_off_t size;
+	ZipEnt *ents = NULL;
+	Source *srcs = NULL;
+	const char *url;
+	Config copy;
+	FILE *mem;
+	Sink sink = {0};
+	int r = -1;
 
 	assert(cfg != NULL);
+	assert(dest != NULL);
 
-	tree = fts_open(path_argv, FTS_LOGICAL|FTS_NOSTAT, entcmp);
-	if (tree == NULL) {
-		warn("fts_open");
-		return -1;
+	cfg = bounded(cfg, &copy);
+
+	/* Ranges only come from one place: the fastest source measured, or
+	 * upstream. Unmeasured mirrors get tried in a full fetch's race. */
+	curl_global_init(CURL_GLOBAL_ALL);
+	if ((nsrcs = load_sources(cfg, &srcs)) == 0)
+		goto out;
+	url = cfg->pages_url;
+	for (i = 0; i < nsrcs; i++) {
+		if (srcs[i].known && srcs[i].rate > 0) {
+			url = srcs[i].url;
+			break;
+		}
 	}
+	if ((curl_handle = curl_open(cfg, url, curl_err)) == NULL)
+		goto out;
 
-	while ((f = fts_read(tree))) {
-		if (f->fts_info != FTS_F)
-			continue; /* Not a file. */
+	/* Learn the size; not every server takes suffix ranges. */
+	curl_easy_setopt(curl_handle, CURLOPT_NOBODY, 1L);
+	if (curl_get(cfg, curl_handle, NULL, &sink, curl_err) == -1 ||
+	    curl_easy_getinfo(curl_handle, CURLINFO_CONTENT_LENGTH_DOWNLOAD_T,
+	                      &size) != CURLE_OK || size <= 0)
+		goto out;
+	curl_easy_setopt(curl_handle, CURLOPT_NOBODY, 0L);
+	curl_easy_setopt(curl_handle, CURLOPT_HTTPGET, 1L);
 
-		if (fnmatch(pattern, f->fts_name, FNM_PERIOD) == 0) {
-			fprintf(cfg->out, "%s/%s\n",
-				f->fts_parent->fts_name, f->fts_name);
+	/* The end of central directory record sits in the last 64 KiB. */
+	if ((mem = sink.dest = open_memstream(&tail, &tail_len)) == NULL)
+		goto out;
+	sha256_init(&sink.sha);
+	sink.limit = ZIP_TAIL;
+	snprintf(range, sizeof(range), "%lld-%lld",
+	         (long long)(size > ZIP_TAIL ? size - ZIP_TAIL : 0),
+	         (long long)size - 1);
+	r = curl_get(cfg, curl_handle, range, &sink, curl_err);
+	fclose(mem);
+	if (r == -1)
+		goto out;
+	r = -1;
+	for (i = (tail_len >= ZIP_EOCD_LEN) ? tail_len - ZIP_EOCD_LEN + 1 : 0; i-- > 0;) {
+		if (memcmp(tail + i, eocd_sig, 4) == 0) {
+			eocd = (unsigned char *)tail + i;
+			break;
 		}
 	}
-	fts_close(tree);
+	if (eocd == NULL) {
+		warnx("no zip directory in %s", url);
+		goto out;
+	}
+	nrecs = le16(eocd + 10);
+	cd_size = le32(eocd + 12);
+	cd_off = le32(eocd + 16);
+	if (nrecs == 0xffff || cd_off == 0xffffffff) {
+		warnx("zip64 archives are not supported");
+		goto out;
+	}
+
+	/* Fetch the central directory. */
+	if ((mem = sink.dest = open_memstream(&cd, &cd_len)) == NULL)
+		goto out;
+	sink.bytes = 0;
+	sink.limit = (size_t)cd_size;
+	snprintf(range, sizeof(range), "%llu-%llu", (unsigned long long)cd_off,
+	         (unsigned long long)(cd_off + cd_size - 1));
+	r = cd_size > 0 ? curl_get(cfg, curl_handle, range, &sink, curl_err) : 0;
+	fclose(mem);
+	if (r == -1 || cd_len != cd_size)
+		goto fail;
+	r = -1;
+
+	/* Compare every file's CRC-32 with the installed copy. */
+	if ((ents = calloc(nrecs, sizeof(*ents))) == NULL)
+		goto out;
+	for (off = 0, i = 0; i < nrecs; i++) {
+		p = (unsigned char *)cd + off;
+		if (off + ZIP_CDH_LEN > cd_len || le32(p) != 0x02014b50)
+			goto fail;
+		name_len = le16(p + 28);
+		if (off + ZIP_CDH_LEN + name_len > cd_len)
+			goto fail;
+		off += ZIP_CDH_LEN + name_len + le16(p + 30) + le16(p + 32);
+		if ((uint64_t)le32(p + 42) + ZIP_LFH_LEN + name_len +
+		    le32(p + 20) > cd_off)
+			goto fail; /* Runs into the central directory. */
+		if (name_len == 0 || p[ZIP_CDH_LEN + name_len - 1] == '/')
+			continue; /* Directory. */
+
+		ents[nents].crc = le32(p + 16);
+		ents[nents].offset = le32(p + 42);
+		snprintf(path, sizeof(path), "%s/%.*s", cfg->pages_home,
+		         (int)name_len, (char *)p + ZIP_CDH_LEN);
+		ents[nents].changed = crc32_file(path, &crc) == -1 ||
+		                      crc != ents[nents].crc;
+		nents++;
+	}
+
+	/* An entry runs up to the next one, or to the central directory. */
+	qsort(ents, nents, sizeof(*ents), zipent_cmp);
+	for (i = 0; i < nents; i++)
+		ents[i].end = (i + 1 < nents) ? ents[i + 1].offset : cd_off;
+
+	/* Fetch runs of adjacent changed entries with one request each. */
+	sink.dest = dest;
+	sink.bytes = 0;
+	sha256_init(&sink.sha);
+	for (i = 0; i < nents; i = j) {
+		for (j = i; j < nents && ents[j].changed; j++)
+			rep.changed++;
+		if (j == i) {
+			j++;
+			continue;
+		}
+		sink.limit = sink.bytes + (size_t)(ents[j - 1].end - ents[i].offset);
+		snprintf(range, sizeof(range), "%llu-%llu",
+		         (unsigned long long)ents[i].offset,
+		         (unsigned long long)ents[j - 1].end - 1);
+		if (curl_get(cfg, curl_handle, range, &sink, curl_err) == -1)
+			goto out;
+	}
+
+	/* An empty directory tells the zip reader it has seen everything. */
+	if (fwrite(eocd_sig, 1, 4, dest) != 4 ||
+	    fwrite((char [ZIP_EOCD_LEN - 4]){0}, 1, ZIP_EOCD_LEN - 4, dest) !=
+	    ZIP_EOCD_LEN - 4 || fflush(dest) == EOF) {
+		warn("unable to write pages");
+		goto out;
+	}
+	rep.bytes = sink.bytes;
+	r = 0;
+	goto out;
+
+fail:
+	warnx("malformed zip directory in %s", url);
+out:
+	if (curl_handle != NULL)
+		curl_easy_cleanup(curl_handle);
+	curl_global_cleanup();
+	free(srcs);
+	free(ents);
+	free(cd);
+	free(tail);
+	if (report != NULL)
+		*report = rep;
+	return r;
+}
+
+int
+extract_pages(const Config *cfg, FILE *archive)
+{
+	struct archive *a = NULL;
+	struct archive *ext = NULL;
+	struct archive_entry *entry;
+	int r, fd;
+	char *path, *tmp;
+	size_t len;
+	const char *entry_path;
+
+	assert(cfg != NULL);
+	assert(archive != NULL);
+
+	a = archive_read_new();
+	if (a == NULL) {
+		warnx("archive_read_new failed");
+		return -1;
+	}
+
+	archive_read_support_filter_all(a);
+	archive_read_support_format_all(a);
+
+	r = archive_read_open_FILE(a, archive);
+	if (r != ARCHIVE_OK) {
+		warnx("archive_read_open_FILE: %s", archive_error_string(a));
+		goto out;
+	}
+
+	ext = archive_write_disk_new();
+	if (ext == NULL) {
+		warnx("archive_write_disk_new failed");
+		r = ARCHIVE_FATAL;
+		goto out;
+	}
+
+	archive_write_disk_set_options(ext, 0);
+
+	while ((r = archive_read_next_header(a, &entry)) == ARCHIVE_OK) {
+		entry_path = archive_entry_pathname(entry);
+		if (entry_path == NULL)
+			entry_path = "";
+
+		/* +2 for / and \0, +7 for .XXXXXX */
+		len = strlen(cfg->pages_home) + strlen(entry_path) + 2;
+		if ((path = malloc(len)) == NULL || (tmp = malloc(len + 7)) == NULL) {
+			warn("malloc");
+			free(path);
+			r = ARCHIVE_FATAL;
+			goto out;
+		}
+		snprintf(path, len, "%s/%s", cfg->pages_home, entry_path);
+
+		/* Readers may have the old page open, so write a file beside it
+		 * and rename it over, rather than truncate it under them. */
+		tmp[0] = '\0';
+		if (archive_entry_filetype(entry) == AE_IFREG) {
+			snprintf(tmp, len + 7, "%s.XXXXXX", path);
+			if ((fd = mkstemp(tmp)) == -1 && errno == ENOENT &&
+			    make_parents(path) == 0) {
+				snprintf(tmp, len + 7, "%s.XXXXXX", path);
+				fd = mkstemp(tmp);
+			}
+			if (fd == -1) {
+				warn("unable to create %s", tmp);
+				r = ARCHIVE_FATAL;
+				goto next;
+			}
+			close(fd);
+		}
+		archive_entry_set_pathname(entry, tmp[0] != '\0' ? tmp : path);
+
+		r = archive_read_extract2(a, entry, ext);
+		if (r != ARCHIVE_OK)
+			warnx("archive_read_extract2: %s", archive_error_string(a));
+		else if (tmp[0] != '\0' && rename(tmp, path) == -1) {
+			warn("unable to rename %s", tmp);
+			r = ARCHIVE_FATAL;
+		}
+		if (r != ARCHIVE_OK && tmp[0] != '\0')
+			unlink(tmp);
+next:
+		free(path);
+		free(tmp);
+		if (r != ARCHIVE_OK)
+			goto out;
+	}
+
+	if (r != ARCHIVE_EOF) {
+		warnx("archive_read_next_header: %s", archive_error_string(a));
+	} else {
+		pack_pages(cfg);
+		if (index_build(cfg->pages_home, NULL) == -1)
+			warnx("unable to index %s", cfg->pages_home);
+	}
+
+out:
+	archive_write_free(ext);
+	archive_read_close(a);
+	archive_read_free(a);
+
+	return (r == ARCHIVE_EOF) ? 0 : -1;
+}
+
+void
+pack_pages(const Config *cfg)
+{
+	char log[PATH_MAX], path[PATH_MAX], tmp[PATH_MAX + 8];
+	char *copies[USAGE_HOT];
+	size_t dest[USAGE_HOT];
+	struct stat st;
+	Usage *used;
+	size_t nused, ncopies = 0, kept, i, len;
+	char *page;
+	int fd, ok;
+
+	if (sidecar_path(log, sizeof(log), cfg->pages_home, USAGE_SUFFIX) == -1 ||
+	    usage_load(log, &used, &nused) == -1 || nused == 0)
+		return;
+
+	/* Files created one after another get neighbouring inodes and blocks,
+	 * so copy the hot pages back to back, most used first. Renaming
+	 * sooner would free inodes for the next copy to reuse. */
+	for (i = kept = 0; i < nused; i++) {
+		COST_ADD(stats, 1);
+		if (snprintf(path, sizeof(path), "%s/%s", cfg->pages_home,
+		             used[i].page) >= (int)sizeof(path) ||
+		    lstat(path, &st) == -1) {
+			free(used[i].page); /* Gone; forget it. */
+			continue;
+		}
+		used[kept++] = used[i];
+		if (ncopies == USAGE_HOT || !S_ISREG(st.st_mode))
+			continue;
+		COST_ADD(opens, 1);
+		if ((fd = open(path, O_RDONLY)) == -1)
+			continue;
+		page = read_fd(fd, &len);
+		close(fd);
+		snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path);
+		if (page != NULL && (fd = mkstemp(tmp)) != -1) {
+			COST_ADD(writes, 1);
+			ok = write(fd, page, len) == (ssize_t)len &&
+			     fchmod(fd, st.st_mode & 07777) == 0;
+			if (close(fd) == -1 || !ok || (copies[ncopies] = strdup(tmp)) == NULL)
+				unlink(tmp);
+			else
+				dest[ncopies++] = kept - 1;
+		}
+		free(page);
+	}
+	for (i = 0; i < ncopies; i++) {
+		snprintf(path, sizeof(path), "%s/%s", cfg->pages_home,
+		         used[dest[i]].page);
+		if (rename(copies[i], path) == -1)
+			unlink(copies[i]);
+		free(copies[i]);
+	}
+
+	/* Updates are rare enough to also keep the log short. */
+	usage_save(log, used, kept);
+	usage_free(used, kept);
+}
+
+int
+make_parents(const char *path)
+{
+	char dir[PATH_MAX];
+	char *p;
+
+	if (snprintf(dir, sizeof(dir), "%s", path) >= (int)sizeof(dir))
+		return -1;
+	for (p = strchr(dir + 1, '/'); p != NULL; p = strchr(p + 1, '/')) {
+		*p = 0;
+		if (mkdir(dir, 0755) == -1 && errno != EEXIST)
+			return -1;
+		*p = '/';
+	}
+	return 0;
+}
+
+int
+lock_updates(const Config *cfg, int wait)
+{
+	struct flock fl = {0};
+	char path[PATH_MAX];
+	int fd;
+
+	if (sidecar_path(path, sizeof(path), cfg->pages_home, LOCK_SUFFIX) == -1)
+		return -1;
+	/* On the first update, the lock is the first thing on disk. */
+	if ((fd = open(path, O_RDWR|O_CREAT, 0644)) == -1 &&
+	    (errno != ENOENT || make_parents(path) == -1 ||
+	     (fd = open(path, O_RDWR|O_CREAT, 0644)) == -1))
+		return -1;
+
+	/* The lock goes away with the process, however it ends. */
+	fl.l_type = F_WRLCK;
+	fl.l_whence = SEEK_SET;
+	if (fcntl(fd, wait ? F_SETLKW : F_SETLK, &fl) == -1) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+long
+file_age(const char *path)
+{
+	struct stat st;
+	time_t now = time(NULL);
+
+	COST_ADD(stats, 1);
+	if (stat(path, &st) == -1)
+		return -1;
+	return (now > st.st_mtime) ? (long)(now - st.st_mtime) : 0;
+}
+
+int
+try_update(const Config *cfg, FetchReport *rep)
+{
+	FILE *temp_file;
+	int r = -1;
+
+	if ((temp_file = tmpfile()) == NULL) {
+		warn("unable to create a temporary file");
+		return -1;
+	}
+
+	/* With pages installed, try to download only what changed. The pieces
+	 * have no digest to check, so verified updates fetch everything. */
+	if (cfg->delta_update && cfg->pages_sha256 == NULL &&
+	    cfg->sums_url == NULL && access(cfg->pages_home, F_OK) == 0) {
+		if (fetch_changed(cfg, temp_file, rep) == 0) {
+			rep->delta = 1;
+			rewind(temp_file);
+			if (rep->changed == 0 || extract_pages(cfg, temp_file) == 0)
+				r = 0;
+			fclose(temp_file);
+			return r;
+		}
+		warnx("downloading all pages instead");
+		fclose(temp_file);
+		if ((temp_file = tmpfile()) == NULL) {
+			warn("unable to create a temporary file");
+			return -1;
+		}
+	}
+
+	/* Download; nothing is extracted unless the checksum matches. */
+	if (fetch_pages(cfg, temp_file, rep) == 0) {
+		rewind(temp_file);
+		r = extract_pages(cfg, temp_file);
+	}
+	fclose(temp_file);
+	return r;
+}
+
+int
+update_pages(const Config *cfg, FetchReport *report)
+{
+	FetchReport rep = {0};
+	Config copy;
+	char path[PATH_MAX];
+	long long pause;
+	int lock_fd, fd, attempt, r;
+
+	assert(cfg != NULL);
+
+	/* Spread a fleet started by the same cron tick over the window. */
+	if (cfg->start_jitter > 0)
+		sleep_ms((long long)random_below((unsigned long)cfg->start_jitter * 1000));
+
+	/* One update at a time; a second one waits and then runs. */
+	if ((lock_fd = lock_updates(cfg, 1)) == -1) {
+		warn("unable to lock %s", cfg->pages_home);
+		return -1;
+	}
+
+	/* Retry with exponential backoff, within the overall timeout. */
+	cfg = bounded(cfg, &copy);
+	for (attempt = 0;; attempt++) {
+		memset(&rep, 0, sizeof(rep));
+		if ((r = try_update(cfg, &rep)) == 0 || attempt >= cfg->retries)
+			break;
+		pause = (long long)RETRY_BASE * 1000 << (attempt < 8 ? attempt : 8);
+		if (pause > RETRY_MAX * 1000)
+			pause = RETRY_MAX * 1000;
+		pause = pause / 2 + (long long)random_below((unsigned long)pause / 2 + 1);
+		if (cfg->deadline != 0 && now_ms() + pause >= cfg->deadline)
+			break;
+		warnx("retrying in %lld seconds", (pause + 999) / 1000);
+		sleep_ms(pause);
+	}
+
+	if (r == 0 &&
+	    sidecar_path(path, sizeof(path), cfg->pages_home, UPDATED_SUFFIX) == 0) {
+		if ((fd = open(path, O_WRONLY|O_CREAT, 0644)) != -1) {
+			futimens(fd, NULL);
+			close(fd);
+		}
+	}
+	close(lock_fd);
+	if (report != NULL)
+		*report = rep;
+	return r;
+}
+
+long
+pages_age(const Config *cfg)
+{
+	char path[PATH_MAX];
+
+	assert(cfg != NULL);
+
+	if (sidecar_path(path, sizeof(path), cfg->pages_home, UPDATED_SUFFIX) == -1)
+		return -1;
+	return file_age(path);
+}
+
+int
+refresh_pages(const Config *cfg, long max_age)
+{
+	char path[PATH_MAX];
+	long age, tried;
+	pid_t pid;
+	int fd, lock_fd, ready[2];
+	char c;
+
+	assert(cfg != NULL);
+
+	/* Two stats on the fast path: pages are fresh, or were just tried. */
+	age = pages_age(cfg);
+	if (age >= 0 && age < max_age)
+		return 0;
+	if (access(cfg->pages_home, F_OK) == -1)
+		return 0; /* Never updated; that is up to the user. */
+	if (sidecar_path(path, sizeof(path), cfg->pages_home, LOCK_SUFFIX) == -1)
+		return -1;
+	tried = file_age(path);
+	if (tried >= 0 && tried < REFRESH_RETRY && tried < max_age)
+		return 0;
+
+	/* Do not hand buffered output to the child. */
+	fflush(NULL);
+	if (pipe(ready) == -1)
+		return -1;
+	if ((pid = fork()) == -1) {
+		close(ready[0]);
+		close(ready[1]);
+		return -1;
+	}
+	if (pid > 0) {
+		close(ready[0]);
+		close(ready[1]);
+		return (waitpid(pid, NULL, 0) == pid) ? 0 : -1;
+	}
+
+	/* Fork again so the update outlives us and is reaped by init. Wait
+	 * until it has tried the lock, so that once we return, anyone taking
+	 * the lock waits for this update rather than beating it. */
+	if (fork() != 0) {
+		close(ready[1]);
+		while (read(ready[0], &c, 1) == -1 && errno == EINTR)
+			;
+		_exit(0);
+	}
+	close(ready[0]);
+	setsid();
+	if ((fd = open("/dev/null", O_RDWR)) != -1) {
+		dup2(fd, STDIN_FILENO);
+		dup2(fd, STDOUT_FILENO);
+		dup2(fd, STDERR_FILENO);
+		if (fd > STDERR_FILENO)
+			close(fd);
+	}
+
+	/* Whoever gets the lock first refreshes; everyone else leaves. */
+	lock_fd = lock_updates(cfg, 0);
+	close(ready[1]);
+	if (lock_fd == -1)
+		_exit(0);
+	futimens(lock_fd, NULL); /* Mark the attempt, successful or not. */
+	age = pages_age(cfg);
+	if (age >= 0 && age < max_age)
+		_exit(0); /* Someone else just did it. */
+	/* The lock is ours already; fcntl locks belong to the process. */
+	_exit(update_pages(cfg, NULL) == 0 ? 0 : 1);
+}
+
+void
+log_use(const Config *cfg, const char *path)
+{
+	char log[PATH_MAX];
+	size_t home_len = strlen(cfg->pages_home);
+
+	/* Pages are logged as they are labelled, platform/name.md. */
+	if (strncmp(path, cfg->pages_home, home_len) != 0 || path[home_len] != '/')
+		return;
+	if (sidecar_path(log, sizeof(log), cfg->pages_home, USAGE_SUFFIX) == 0)
+		usage_record(log, path + home_len + 1);
+}
+
+int
+prefetch(const char *path)
+{
+	int fd, r;
+
+	COST_ADD(opens, 1);
+	if ((fd = open(path, O_RDONLY)) == -1)
+		return -1;
+	/* Starts reading in the background; nothing waits for the disk. */
+	r = posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+	close(fd);
+	return (r == 0) ? 0 : -1;
+}
+
+int
+warm_pages(const Config *cfg)
+{
+	char path[PATH_MAX];
+	Usage *used;
+	size_t nused, i;
+	int n = 0;
+
+	assert(cfg != NULL);
+
+	/* The index first; every lookup reads it. */
+	if (sidecar_path(path, sizeof(path), cfg->pages_home, INDEX_SUFFIX) == 0)
+		prefetch(path);
+	if (sidecar_path(path, sizeof(path), cfg->pages_home, USAGE_SUFFIX) == -1 ||
+	    usage_load(path, &used, &nused) == -1)
+		return -1;
+	for (i = 0; i < nused && i < USAGE_HOT; i++) {
+		if (snprintf(path, sizeof(path), "%s/%s", cfg->pages_home,
+		             used[i].page) < (int)sizeof(path) && prefetch(path) == 0)
+			n++;
+	}
+	usage_free(used, nused);
+	return n;
+}
+
+Index *
+open_index(const Config *cfg)
+{
+	Index *idx;
+
+	/* Rebuild a missing or stale index; use it even if it cannot be saved. */
+	idx = index_open(cfg->pages_home);
+	if (idx == NULL)
+		index_build(cfg->pages_home, &idx);
+	return idx;
+}
+
+char *
+page_path(const Config *cfg, const char *rel)
+{
+	size_t len = strlen(cfg->pages_home) + strlen(rel) + 2;
+	char *path;
+
+	if ((path = malloc(len)) == NULL)
+		return NULL;
+	snprintf(path, len, "%s/%s", cfg->pages_home, rel);
+	return path;
+}
+
+char *
+find_first(const Config *cfg, const char *const names[], int n,
+           const char *platform, int *which)
+{
+	char rel[PATH_MAX];
+	char *found = NULL;
+	Index *idx;
+	int i;
+
+	/* One index serves every name; it knows where a walk would stop. */
+	if ((idx = open_index(cfg)) == NULL)
+		return NULL;
+	for (i = 0; i < n; i++) {
+		if (index_find(idx, cfg->pages_home, names[i], platform, rel,
+		               sizeof(rel)) == 0) {
+			found = page_path(cfg, rel);
+			*which = i;
+			break;
+		}
+	}
+	index_close(idx);
+	return found;
+}
+
+char *
+read_fd(int fd, size_t *len)
+{
+	struct stat st;
+	size_t cap = READ_CHUNK;
+	char *buf, *tmp;
+	ssize_t n;
+
+	/* One read() is enough when the size is known up front. */
+	if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0)
+		cap = (size_t)st.st_size + 1;
+	if ((buf = malloc(cap)) == NULL)
+		return NULL;
+
+	*len = 0;
+	while ((n = read(fd, buf + *len, cap - *len)) != 0) {
+		if (n == -1) {
+			free(buf);
+			return NULL;
+		}
+		COST_ADD(bytes, n);
+		*len += (size_t)n;
+		if (*len == cap) {
+			if ((tmp = realloc(buf, cap * 2)) == NULL) {
+				free(buf);
+				return NULL;
+			}
+			buf = tmp;
+			cap *= 2;
+		}
+	}
+	return buf;
+}
+
+#else /* EMBED_PAGES */
+
+/* Pages are built into the binary; there is nothing to download. */
+int
+fetch_pages(const Config *cfg, FILE *dest, FetchReport *report)
+{
+	(void)cfg;
+	(void)dest;
+	(void)report;
+	warnx("pages are built in; rebuild to update them");
+	return -1;
+}
+
+int
+fetch_changed(const Config *cfg, FILE *dest, FetchReport *report)
+{
+	return fetch_pages(cfg, dest, report);
+}
+
+int
+extract_pages(const Config *cfg, FILE *archive)
+{
+	(void)cfg;
+	(void)archive;
+	warnx("pages are built in; rebuild to update them");
+	return -1;
+}
+
+int
+update_pages(const Config *cfg, FetchReport *report)
+{
+	return fetch_pages(cfg, NULL, report);
+}
+
+long
+pages_age(const Config *cfg)
+{
+	(void)cfg;
+	return -1;
+}
+
+int
+refresh_pages(const Config *cfg, long max_age)
+{
+	(void)cfg;
+	(void)max_age;
+	return 0;
+}
+
+int
+warm_pages(const Config *cfg)
+{
+	/* The pages come in with the executable. */
+	(void)cfg;
+	return 0;
+}
+
+char *
+embed_path(const Config *cfg, const EmbedPage *page)
+{
+	size_t len;
+	char *path;
+
+	/* Shaped like a page on disk, so load_page() takes either. */
+	len = strlen(cfg->pages_home) + strlen(page->platform) +
+	      strlen(page->name) + 3;
+	if ((path = malloc(len)) == NULL)
+		return NULL;
+	snprintf(path, len, "%s/%s/%s", cfg->pages_home, page->platform,
+	         page->name);
+	return path;
+}
+
+char *
+find_first(const Config *cfg, const char *const names[], int n,
+           const char *platform, int *which)
+{
+	const EmbedPage *page;
+	int i;
+
+	for (i = 0; i < n; i++) {
+		if ((page = embed_find(names[i], platform)) != NULL) {
+			*which = i;
+			return embed_path(cfg, page);
+		}
+	}
+	return NULL;
+}
+#endif /* EMBED_PAGES */
+
+char *
+find_page(const Config *cfg, const char *name, const char *platform)
+{
+	int which;
+
+	assert(cfg != NULL);
+	assert(name != NULL);
+
+	return find_first(cfg, &name, 1, platform, &which);
+}
+
+char *
+resolve_page(const Config *cfg, char *const words[], int n,
+             const char *platform, int *used)
+{
+	char joined[NAME_MAX + 1], (*names)[NAME_MAX + 1];
+	const char **order;
+	size_t len = 0, wlen;
+	char *found = NULL;
+	int i, fit, which;
+
+	assert(cfg != NULL);
+	assert(words != NULL);
+	assert(used != NULL);
+
+	if (n <= 0)
+		return NULL;
+	names = malloc(n * sizeof(*names));
+	order = malloc(n * sizeof(*order));
+	if (names == NULL || order == NULL)
+		goto out;
+
+	/* "a.md", "a-b.md", ... for as many words as fit in a file name. */
+	for (fit = 0; fit < n; fit++) {
+		wlen = strlen(words[fit]);
+		if (len + (fit > 0) + wlen + strlen(PAGE_EXT) > NAME_MAX)
+			break;
+		if (fit > 0)
+			joined[len++] = '-';
+		memcpy(joined + len, words[fit], wlen);
+		len += wlen;
+		memcpy(names[fit], joined, len);
+		memcpy(names[fit] + len, PAGE_EXT, sizeof(PAGE_EXT));
+	}
+	/* Longest first, so "git commit --amend" stops at git-commit. */
+	for (i = 0; i < fit; i++)
+		order[i] = names[fit - 1 - i];
+	if ((found = find_first(cfg, order, fit, platform, &which)) != NULL)
+		*used = fit - which;
+
+out:
+	free(names);
+	free(order);
+	return found;
+}
+
+char *
+load_page(const Config *cfg, const char *path, size_t *len)
+{
+#ifdef EMBED_PAGES
+	const EmbedPage *page = NULL;
+	char buf[PATH_MAX], *name, *text;
+	size_t home_len = strlen(cfg->pages_home);
+	const char *label = path;
+
+	/* Look up platform/name.md; no file is opened. */
+	if (strncmp(label, cfg->pages_home, home_len) == 0 && label[home_len] == '/')
+		label += home_len + 1;
+	if (strlen(label) < sizeof(buf) &&
+	    (name = strrchr(strcpy(buf, label), '/')) != NULL) {
+		*name++ = 0;
+		page = embed_find(name, buf);
+	}
+	if (page == NULL) {
+		warnx("unable to open %s", path);
+		return NULL;
+	}
+	if ((text = embed_read(page, len)) == NULL)
+		warnx("unable to read %s", path);
+	return text;
+#else
+	char *page;
+	int fd;
+
+	(void)cfg;
+	COST_ADD(opens, 1);
+	if ((fd = open(path, O_RDONLY)) == -1) {
+		warn("unable to open %s", path);
+		return NULL;
+	}
+	page = read_fd(fd, len);
+	close(fd);
+	if (page == NULL)
+		warn("unable to read %s", path);
+	return page;
+#endif /* EMBED_PAGES */
+}
+
+void
+render_line(const Config *cfg, int styles, const char *buf, size_t line,
+            size_t eol, const Mark *m, const Mark *end, FILE *out)
+{
+	const char *style;
+	size_t cur;
+	int command, code, holder;
+
+	if (!styles) {
+		fwrite(buf + line, 1, eol - line, out);
+		putc('\n', out);
+		return;
+	}
+
+	/* Choose styling by the first character. */
+	switch (eol > line ? buf[line] : 0) {
+	case HEADING_TOKEN:
+		style = cfg->heading_style;
+		break;
+	case SUMMARY_TOKEN:
+		style = cfg->summary_style;
+		break;
+	case COMMENT_TOKEN:
+		style = cfg->comment_style;
+		break;
+	case COMMAND_TOKEN:
+		style = cfg->command_style;
+		break;
+	default:
+		style = NULL;
+	}
+	if (style != NULL)
+		fputs(style, out);
+
+	/* Inline `code` and {{placeholders}}; a command line is code
+	 * already, so its backticks are left alone. */
+	command = eol > line && buf[line] == COMMAND_TOKEN;
+	code = holder = 0;
+	for (cur = line; m < end; m++) {
+		if (m->kind == MARK_BACKTICK && !command && !holder &&
+		    cfg->code_style != NULL) {
+			if (!code) {
+				fwrite(buf + cur, 1, m->pos - cur, out);
+				fputs(cfg->code_style, out);
+				cur = m->pos;
+			} else {
+				fwrite(buf + cur, 1, m->pos + 1 - cur, out);
+				fputs(cfg->reset_style, out);
+				if (style != NULL)
+					fputs(style, out);
+				cur = m->pos + 1;
+			}
+			code = !code;
+		} else if (m->kind == MARK_OPEN && !holder &&
+		           cfg->placeholder_style != NULL) {
+			fwrite(buf + cur, 1, m->pos - cur, out);
+			fputs(cfg->placeholder_style, out);
+			cur = m->pos;
+			holder = 1;
+		} else if (m->kind == MARK_CLOSE && holder) {
+			fwrite(buf + cur, 1, m->pos + 2 - cur, out);
+			fputs(cfg->reset_style, out);
+			if (code)
+				fputs(cfg->code_style, out);
+			else if (style != NULL)
+				fputs(style, out);
+			cur = m->pos + 2;
+			holder = 0;
+		}
+	}
+	fwrite(buf + cur, 1, eol - cur, out);
+	if (style != NULL || code || holder)
+		fputs(cfg->reset_style, out);
+	putc('\n', out);
+}
+
+int
+render_page(const Config *cfg, int styles, const char *buf, size_t len, FILE *out)
+{
+	Mark stack[PAGE_MARKS], *marks = stack, *m, *first, *tmp;
+	size_t cap = PAGE_MARKS, n = 0, pos = 0, line = 0;
+
+	/* One pass over the page finds every line break and span boundary;
+	 * lines are rendered as soon as their marks are in. */
+	while (line < len) {
+		if (cap - 1 - n < MARKUP_MIN) {
+			/* A line with more marks than fit; make room. */
+			if ((tmp = malloc(cap * 2 * sizeof(Mark))) == NULL) {
+				warn("malloc");
+				if (marks != stack)
+					free(marks);
+				return -1;
+			}
+			memcpy(tmp, marks, n * sizeof(Mark));
+			if (marks != stack)
+				free(marks);
+			marks = tmp;
+			cap *= 2;
+		}
+		if (pos < len) {
+			/* Keep a slot for the end of a last line. */
+			n += markup_scan_from(buf, len, &pos, marks + n, cap - 1 - n);
+			if (pos == len) {
+				marks[n].pos = len;
+				marks[n++].kind = MARK_NEWLINE;
+			}
+		}
+
+		for (first = m = marks; m < marks + n && line < len; m++) {
+			if (m->kind != MARK_NEWLINE)
+				continue;
+			/* Skip empty lines if needed. */
+			if (!cfg->skip_empty || m->pos > line || m->pos == len)
+				render_line(cfg, styles, buf, line, m->pos, first, m, out);
+			line = m->pos + 1;
+			first = m + 1;
+		}
+
+		/* Marks of a line not yet complete move to the front. */
+		n -= (size_t)(first - marks);
+		memmove(marks, first, n * sizeof(Mark));
+	}
+	if (marks != stack)
+		free(marks);
+
+	if (ferror(out)) {
+		warn("unable to print page");
+		return -1;
+	}
+	return 0;
+}
+
+int
+print_page(const Config *cfg, FILE *page)
+{
+	char *buf, *tmp;
+	size_t len = 0, cap = READ_CHUNK, n;
+	int r;
+
+	assert(cfg != NULL);
+	assert(page != NULL);
+
+	/* Render from memory; the page is read in as few calls as possible. */
+	if ((buf = malloc(cap)) == NULL)
+		return -1;
+	while ((n = fread(buf + len, 1, cap - len, page)) > 0) {
+		COST_ADD(bytes, n);
+		len += n;
+		if (len == cap) {
+			if ((tmp = realloc(buf, cap * 2)) == NULL) {
+				free(buf);
+				return -1;
+			}
+			buf = tmp;
+			cap *= 2;
+		}
+	}
+	if (ferror(page)) {
+		warn("unable to read page");
+		free(buf);
+		return -1;
+	}
+
+	r = render_page(cfg, cfg->apply_styles == 1, buf, len, cfg->out);
+	free(buf);
+	return r;
+}
+
+int
+show_page(const Config *cfg, const char *path)
+{
+	char *page;
+	size_t len;
+	int r;
+
+	assert(cfg != NULL);
+	assert(path != NULL);
+
+	if ((page = load_page(cfg, path, &len)) == NULL)
+		return -1;
+	r = render_page(cfg, cfg->apply_styles == 1, page, len, cfg->out);
+	free(page);
+#ifndef EMBED_PAGES
+	if (r == 0 && cfg->track_usage)
+		log_use(cfg, path);
+#endif /* EMBED_PAGES */
+	return r;
+}
+
+void
+escape_html(const char *s, int len, FILE *out)
+{
+	int i;
+
+	for (i = 0; i < len; i++) {
+		switch (s[i]) {
+		case '&': fputs("&amp;", out); break;
+		case '<': fputs("&lt;", out); break;
+		case '>': fputs("&gt;", out); break;
+		case '"': fputs("&quot;", out); break;
+		default: fputc(s[i], out);
+		}
+	}
+}
+
+void
+escape_json(const char *s, size_t len, FILE *out)
+{
+	size_t i;
+
+	fputc('"', out);
+	for (i = 0; i < len; i++) {
+		if (s[i] == '"' || s[i] == '\\')
+			fprintf(out, "\\%c", s[i]);
+		else if (s[i] == '\n')
+			fputs("\\n", out);
+		else if ((unsigned char)s[i] < 0x20)
+			fprintf(out, "\\u%04x", (unsigned char)s[i]);
+		else
+			fputc(s[i], out);
+	}
+	fputc('"', out);
+}
+
+int
+render_html(const char *label, const char *buf, size_t len, FILE *out)
+{
+	const char *line = buf, *end = buf + len, *nl, *open, *close;
+	int line_len, skip;
+
+	fputs("<section id=\"", out);
+	escape_html(label, (int)strlen(label), out);
+	fputs("\">\n", out);
+	while (line < end) {
+		nl = memchr(line, '\n', end - line);
+		line_len = (int)((nl != NULL ? nl : end) - line);
+		skip = 0;
+
+		/* Same line kinds as the terminal, marked up instead of styled. */
+		switch (line_len > 0 ? line[0] : 0) {
+		case 0:
+			open = close = NULL;
+			break;
+		case HEADING_TOKEN:
+			open = "<h1>", close = "</h1>", skip = 1;
+			break;
+		case SUMMARY_TOKEN:
+			open = "<p class=\"summary\">", close = "</p>", skip = 1;
+			break;
+		case COMMENT_TOKEN:
+			open = "<p class=\"comment\">", close = "</p>", skip = 1;
+			break;
+		case COMMAND_TOKEN:
+			open = "<pre><code>", close = "</code></pre>", skip = 1;
+			if (line_len > 1 && line[line_len - 1] == COMMAND_TOKEN)
+				line_len--;
+			break;
+		default:
+			open = "<p>", close = "</p>";
+		}
+		if (open != NULL) {
+			/* Drop the token and the space after it. */
+			if (skip && line_len > 1 && line[1] == ' ')
+				skip = 2;
+			fputs(open, out);
+			escape_html(line + skip, line_len - skip, out);
+			fprintf(out, "%s\n", close);
+		}
+		line = (nl != NULL) ? nl + 1 : end;
+	}
+	return (fputs("</section>\n", out) == EOF) ? -1 : 0;
+}
+
+int
+render_json(const char *label, const char *buf, size_t len, FILE *out)
+{
+	const char *name = strrchr(label, '/');
+	size_t name_len;
+
+	name = (name != NULL) ? name + 1 : label;
+	name_len = strlen(name);
+	if (name_len > strlen(PAGE_EXT) &&
+	    strcmp(name + name_len - strlen(PAGE_EXT), PAGE_EXT) == 0)
+		name_len -= strlen(PAGE_EXT);
+
+	fputs("{\"name\": ", out);
+	escape_json(name, name_len, out);
+	fputs(", \"platform\": ", out);
+	escape_json(label, name > label ? (size_t)(name - label - 1) : 0, out);
+	fputs(", \"body\": ", out);
+	escape_json(buf, len, out);
+	return (fputs("}", out) == EOF) ? -1 : 0;
+}
+
+int
+render_file(const Config *cfg, int format, const char *path, Slot *slot)
+{
+	const char *label;
+	FILE *mem;
+	char *page;
+	size_t len, home_len = strlen(cfg->pages_home);
+	int r;
+
+	if ((page = load_page(cfg, path, &len)) == NULL)
+		return -1;
+
+	/* Pages under the cache are labelled platform/name.md. */
+	label = path;
+	if (strncmp(path, cfg->pages_home, home_len) == 0 && path[home_len] == '/')
+		label = path + home_len + 1;
+
+	/* Render into memory so the writer can emit pages in order. */
+	if ((mem = open_memstream(&slot->buf, &slot->len)) == NULL) {
+		free(page);
+		return -1;
+	}
+	switch (format) {
+	case EXPORT_HTML:
+		r = render_html(label, page, len, mem);
+		break;
+	case EXPORT_JSON:
+		r = render_json(label, page, len, mem);
+		break;
+	default:
+		r = render_page(cfg, format == EXPORT_ANSI, page, len, mem);
+	}
+	if (fclose(mem) == EOF)
+		r = -1;
+	free(page);
+	return r;
+}
+
+void *
+batch_reader(void *arg)
+{
+	Batch *b = arg;
+	size_t i;
+	int r;
+
+	for (;;) {
+		pthread_mutex_lock(&b->mu);
+		while (b->next < b->n && b->next >= b->written + b->window)
+			pthread_cond_wait(&b->cv, &b->mu);
+		if (b->next >= b->n) {
+			pthread_mutex_unlock(&b->mu);
+			return NULL;
+		}
+		i = b->next++;
+		pthread_mutex_unlock(&b->mu);
+
+		r = render_file(b->cfg, b->format, b->paths[i], &b->slots[i]);
+
+		pthread_mutex_lock(&b->mu);
+		b->slots[i].state = (r == 0) ? SLOT_DONE : SLOT_FAILED;
+		pthread_cond_broadcast(&b->cv);
+		pthread_mutex_unlock(&b->mu);
+	}
+}
+
+int
+run_batch(Batch *b)
+{
+	pthread_t readers[MAX_READERS];
+	long ncpu;
+	size_t nreaders, started, i;
+	int r = 0, first = 1;
+
+	if (b->n == 0)
+		return 0;
+
+	/* Reads mostly wait on the disk, so use more readers than cores. */
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	nreaders = (ncpu > 0) ? (size_t)ncpu * 2 : 4;
+	if (nreaders > MAX_READERS)
+		nreaders = MAX_READERS;
+	if (nreaders > b->n)
+		nreaders = b->n;
+
+	b->next = b->written = 0;
+	b->window = nreaders * 4;
+	if ((b->slots = calloc(b->n, sizeof(Slot))) == NULL)
+		return -1;
+	pthread_mutex_init(&b->mu, NULL);
+	pthread_cond_init(&b->cv, NULL);
+
+	for (started = 0; started < nreaders; started++)
+		if (pthread_create(&readers[started], NULL, batch_reader, b) != 0)
+			break;
+	if (started == 0) {
+		/* No threads; read the pages right here instead. */
+		b->window = b->n;
+		batch_reader(b);
+	}
+
+	/* Write each page as soon as it and all pages before it are ready. */
+	for (i = 0; i < b->n; i++) {
+		pthread_mutex_lock(&b->mu);
+		while (b->slots[i].state == SLOT_PENDING)
+			pthread_cond_wait(&b->cv, &b->mu);
+		pthread_mutex_unlock(&b->mu);
+
+		if (b->slots[i].state == SLOT_FAILED) {
+			r = -1;
+		} else if ((!first && fputs(b->sep, b->cfg->out) == EOF) ||
+		           fwrite(b->slots[i].buf, 1, b->slots[i].len, b->cfg->out)
+		           != b->slots[i].len) {
+			warn("unable to print page");
+			r = -1;
+		} else {
+			first = 0;
+		}
+		free(b->slots[i].buf);
+		b->slots[i].buf = NULL;
+
+		pthread_mutex_lock(&b->mu);
+		b->written = i + 1;
+		pthread_cond_broadcast(&b->cv);
+		pthread_mutex_unlock(&b->mu);
+	}
+
+	for (i = 0; i < started; i++)
+		pthread_join(readers[i], NULL);
+	pthread_cond_destroy(&b->cv);
+	pthread_mutex_destroy(&b->mu);
+	free(b->slots);
+	return r;
+}
+
+int
+print_pages(const Config *cfg, char *const paths[], size_t n)
+{
+	Batch b = {0};
+
+	assert(cfg != NULL);
+	assert(paths != NULL || n == 0);
+
+	b.cfg = cfg;
+	b.format = (cfg->apply_styles == 1) ? EXPORT_ANSI : EXPORT_TEXT;
+	b.sep = "";
+	b.paths = paths;
+	b.n = n;
+	return run_batch(&b);
+}
+
+int
+export_pages(const Config *cfg, int format)
+{
+	Batch b = {0};
+	char **paths;
+	size_t n, i;
+	int r;
+
+	assert(cfg != NULL);
+
+	if (collect_pages(cfg, &paths, &n) == -1)
+		return -1;
+
+	b.cfg = cfg;
+	b.format = format;
+	b.paths = paths;
+	b.n = n;
+	switch (format) {
+	case EXPORT_HTML:
+		b.sep = "";
+		fputs("<!DOCTYPE html>\n<html>\n<head><meta charset=\"utf-8\">"
+		      "<title>tldr pages</title></head>\n<body>\n", cfg->out);
+		break;
+	case EXPORT_JSON:
+		b.sep = ",\n";
+		fputs("[\n", cfg->out);
+		break;
+	default:
+		b.sep = "\n";
+	}
+
+	r = run_batch(&b);
+
+	if (format == EXPORT_HTML)
+		fputs("</body>\n</html>\n", cfg->out);
+	else if (format == EXPORT_JSON)
+		fputs("\n]\n", cfg->out);
+	if (fflush(cfg->out) == EOF)
+		r = -1;
+
+	for (i = 0; i < n; i++)
+		free(paths[i]);
+	free(paths);
+	return r;
+}
+
+#ifndef EMBED_PAGES
+int
+collect_pages(const Config *cfg, char ***paths, size_t *n)
+{
+	Walk w;
+	size_t i;
+
+	*paths = NULL;
+	*n = 0;
+	if (walk_tree(cfg->pages_home, &w) == -1) {
+		warn("unable to walk %s", cfg->pages_home);
+		return -1;
+	}
+	if (w.nfiles > 0 && (*paths = malloc(w.nfiles * sizeof(**paths))) == NULL)
+		goto fail;
+
+	/* Same pages, same order as list_pages(). */
+	for (i = 0; i < w.nfiles; i++) {
+		if (fnmatch("*"PAGE_EXT, w.files[i].name, FNM_PERIOD) != 0)
+			continue;
+		if (((*paths)[*n] = page_path(cfg, w.files[i].path)) == NULL)
+			goto fail;
+		(*n)++;
+	}
+	walk_free(&w);
+	return 0;
+
+fail:
+	warn("unable to collect pages");
+	walk_free(&w);
+	while (*n > 0)
+		free((*paths)[--*n]);
+	free(*paths);
+	*paths = NULL;
+	return -1;
+}
+
+int
+list_pages(const Config *cfg)
+{
+	const char *pattern = "*.md";
+	char parent[PATH_MAX];
+	Walk w;
+	size_t i;
+
+	assert(cfg != NULL);
+
+	if (walk_tree(cfg->pages_home, &w) == -1) {
+		warn("unable to walk %s", cfg->pages_home);
+		return -1;
+	}
+
+	for (i = 0; i < w.nfiles; i++) {
+		if (fnmatch(pattern, w.files[i].name, FNM_PERIOD) == 0) {
+			fprintf(cfg->out, "%s/%s\n",
+				walk_parent(cfg->pages_home, w.files[i].path, parent,
+				            sizeof(parent)),
+				w.files[i].name);
+		}
+	}
+	walk_free(&w);
+	return 0;
+}
+
+int
+suggest_pages(const Config *cfg, const char *name, char *list[], int max)
+{
+	const char **found;
+	size_t len, ext = strlen(PAGE_EXT);
+	unsigned tol;
+	Index *idx;
+	int i, n;
+
+	assert(cfg != NULL);
+	assert(name != NULL);
+
+	if (max <= 0 || (found = malloc(max * sizeof(*found))) == NULL)
+		return 0;
+	if ((idx = open_index(cfg)) == NULL) {
+		free(found);
+		return 0;
+	}
+	/* The lookup fell through; make sure that was not a stale index. */
+	if (!index_fresh(idx, cfg->pages_home)) {
+		index_close(idx);
+		index_build(cfg->pages_home, &idx);
+		if (idx == NULL) {
+			free(found);
+			return 0;
+		}
+	}
+
+	/* Allow one edit in tiny names and two (a transposition) otherwise. */
+	len = strlen(name);
+	if (len > ext && strcmp(name + len - ext, PAGE_EXT) == 0)
+		len -= ext;
+	tol = (len <= 2) ? 1 : 2;
+
+	n = index_suggest(idx, name, tol, found, max);
+	for (i = 0; i < n; i++) {
+		len = strlen(found[i]);
+		if (len > ext && strcmp(found[i] + len - ext, PAGE_EXT) == 0)
+			len -= ext;
+		list[i] = strndup(found[i], len);
+		if (list[i] == NULL)
+			break;
+	}
+
+	index_close(idx);
+	free(found);
+	return i;
+}
+
+#else /* EMBED_PAGES */
+
+int
+collect_pages(const Config *cfg, char ***paths, size_t *n)
+{
+	*paths = NULL;
+	*n = 0;
+	if (embed_npages > 0 &&
+	    (*paths = malloc(embed_npages * sizeof(**paths))) == NULL)
+		goto fail;
+
+	/* Built-in pages are already in list_pages() order. */
+	for (; *n < embed_npages; (*n)++)
+		if (((*paths)[*n] = embed_path(cfg, &embed_pages[*n])) == NULL)
+			goto fail;
+	return 0;
+
+fail:
+	warn("unable to collect pages");
+	while (*n > 0)
+		free((*paths)[--*n]);
+	free(*paths);
+	*paths = NULL;
+	return -1;
+}
+
+int
+list_pages(const Config *cfg)
+{
+	size_t i;
+
+	assert(cfg != NULL);
+
+	for (i = 0; i < embed_npages; i++)
+		fprintf(cfg->out, "%s/%s\n", embed_pages[i].platform,
+		        embed_pages[i].name);
+	return 0;
+}
+
+int
+suggest_pages(const Config *cfg, const char *name, char *list[], int max)
+{
+	/* There is no index to suggest from; a miss is just a miss. */
+	(void)cfg;
+	(void)name;
+	(void)list;
+	(void)max;
 	return 0;
 }
+#endif /* EMBED_PAGES */
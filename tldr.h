@@ -8,6 +8,13 @@
 typedef struct {
 	/* URL where to download pages from. */
 	const char *pages_url;
+	/* Expected SHA-256 of the archive in hex, or NULL. */
+	const char *pages_sha256;
+	/* URL of a sha256sums file listing the archive, or NULL. */
+	const char *sums_url;
+	/* NULL-terminated list of URLs serving the same archive, tried before
+	 * pages_url; the fastest ones are raced. NULL for none. */
+	const char *const *mirrors;
 	/* User agent used to download pages. */
 	const char *user_agent;
 	/* Extract pages from the archive here. */
@@ -17,7 +24,28 @@ typedef struct {
 	const char *summary_style;
 	const char *comment_style;
 	const char *command_style;
+	/* Inline `code` outside command lines, and {{placeholders}}; NULL to
+	 * leave them as they are. */
+	const char *code_style;
+	const char *placeholder_style;
 	const char *reset_style;
+	/* Fetch only changed pages when possible? */
+	int delta_update;
+	/* Download at most this many bytes per second; 0 for no limit. */
+	long max_rate;
+	/* Abort a transfer slower than low_speed_limit bytes per second for
+	 * low_speed_time seconds; 0 to wait forever. Lowered to half of
+	 * max_rate if that is not below it. */
+	long low_speed_limit;
+	long low_speed_time;
+	/* Give up on downloading after this many seconds; 0 for never. */
+	long timeout;
+	/* Retry a failed update this many times, backing off exponentially. */
+	int retries;
+	/* Wait a random time of up to this many seconds before updating. */
+	long start_jitter;
+	/* Log every page shown, so updates can keep the most used together? */
+	int track_usage;
 	/* Print empty lines from pages? */
 	int skip_empty;
 	/* Apply styles? */
@@ -28,19 +56,72 @@ typedef struct {
 
 typedef struct Config Config; /* Defined in tldr.c */
 
+/* Output formats for export_pages(). */
+enum { EXPORT_ANSI, EXPORT_TEXT, EXPORT_HTML, EXPORT_JSON };
+
+typedef struct {
+	/* Bytes written to the destination. */
+	size_t bytes;
+	/* SHA-256 of those bytes in hex; empty after fetch_changed(). */
+	char sha256[65];
+	/* 1 if the digest matched a configured or published checksum. */
+	int verified;
+	/* Archive entries downloaded by fetch_changed(). */
+	size_t changed;
+	/* 1 if update_pages() only fetched changed entries. */
+	int delta;
+} FetchReport;
+
 /* Allocate and populate config. */
 Config *create_cfg(const ConfigOpts *opts);
-/* Deallocate config recursively. */
+/* Deallocate config. */
 void destroy_cfg(Config *cfg);
-/* Download the archive with pages. */
-int fetch_pages(const Config *cfg, FILE *dest);
+/* Download the archive with pages and verify its checksum. Fails if a
+ * checksum or sums URL is configured but no digest can be had.
+ * Mirrors are raced, fastest first, and measured for the next time. The
+ * report is optional. */
+int fetch_pages(const Config *cfg, FILE *dest, FetchReport *report);
+/* Download only the archive entries whose CRC-32 differs from the
+ * installed pages, using HTTP range requests, as an archive that
+ * extract_pages() accepts. Fails if the server cannot serve ranges. */
+int fetch_changed(const Config *cfg, FILE *dest, FetchReport *report);
 /* Extract pages from the archive. */
 int extract_pages(const Config *cfg, FILE *archive);
+/* Fetch and extract pages, holding the update lock; only changed pages are
+ * fetched if delta_update is set, no checksum or sums URL is configured and
+ * pages are installed. Honours the start jitter, retries and the timeout. */
+int update_pages(const Config *cfg, FetchReport *report);
+/* Seconds since the last successful update_pages(), -1 if unknown. */
+long pages_age(const Config *cfg);
+/* If pages are older than max_age seconds, update them in a detached
+ * background process. Returns once that process holds the update lock, or
+ * has found it taken; concurrent calls start one update. */
+int refresh_pages(const Config *cfg, long max_age);
 /* Find a page by file name. The caller must free the returned string. */
 char *find_page(const Config *cfg, const char *name, const char *platform);
+/* Find the page named by the most leading words joined with dashes, such
+ * as git-commit.md for "git commit --amend", and set used to how many it
+ * took. The caller must free the returned string. */
+char *resolve_page(const Config *cfg, char *const words[], int n,
+                   const char *platform, int *used);
 /* Write page to the given file. */
 int print_page(const Config *cfg, FILE *page);
+/* Write the page at path, as returned by find_page(), to the output, and
+ * log the use if track_usage is set. */
+int show_page(const Config *cfg, const char *path);
+/* Ask the kernel to read the index and the most used pages ahead, so the
+ * next lookups do not wait on the disk. Returns how many pages it asked
+ * for. */
+int warm_pages(const Config *cfg);
+/* Write the pages at paths in order; they are read and rendered in
+ * parallel. Missing pages are skipped and make the call fail. */
+int print_pages(const Config *cfg, char *const paths[], size_t n);
+/* Write every page, sorted like list_pages(), as a single document. */
+int export_pages(const Config *cfg, int format);
 /* List all available pages. */
 int list_pages(const Config *cfg);
+/* Store up to max names of existing pages close to name in list; return how
+ * many were stored. The caller must free the returned strings. */
+int suggest_pages(const Config *cfg, const char *name, char *list[], int max);
 
 #endif /* TLDR_H */
@@ -3,43 +3,148 @@
 #ifdef NDEBUG
 #error "Enable assert() for unit tests."
 #endif
+#define _GNU_SOURCE /* fopencookie() on glibc. */
 #include <assert.h>
 
+#include <fcntl.h>
 #include <fts.h>
 #include <limits.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
+#include "cost.h"
+#include "markup.h"
 #include "tldr.h"
 
 #define URL_SIZE 2048
 #define URL_PROTO "file://"
 #define MKTEMP_TEMPLATE "/tmp/tinytldr_XXXXXX"
 #define FETCH_PAYLOAD "abcdef666\n"
+#define FETCH_SHA256 "d9c626031621c569748e0b975bdb67c1ddb653c2b561587f92aa80a085933c51"
+#define OUT_BUF 4096 /* Output buffer of the counting stream. */
 
 struct Config {
 	char *pages_url;
+	char *pages_sha256;
+	char *sums_url;
+	char **mirrors;
 	char *user_agent;
 	char *pages_home;
 	char *heading_style;
 	char *summary_style;
 	char *comment_style;
 	char *command_style;
+	char *code_style;
+	char *placeholder_style;
 	char *reset_style;
+	int delta_update;
+	long max_rate;
+	long low_speed_limit;
+	long low_speed_time;
+	long timeout;
+	int retries;
+	long start_jitter;
+	long long deadline;
+	int track_usage;
 	int skip_empty;
 	int apply_styles;
 	FILE *out;
 };
 
+static const unsigned char test_archive_zip[] = {
+	0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0xb4,
+	0x04, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x2e, 0x2f, 0x50, 0x4b, 0x03, 0x04,
+	0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0xb4, 0x04, 0x5d, 0xe5, 0x4b,
+	0x35, 0x9a, 0x20, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x0b, 0x00,
+	0x00, 0x00, 0x61, 0x72, 0x63, 0x68, 0x69, 0x76, 0x65, 0x2e, 0x7a, 0x69,
+	0x70, 0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46,
+	0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x2e, 0x2f, 0x50, 0x4b, 0x03,
+	0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0xb4, 0x04, 0x5d, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04,
+	0x00, 0x00, 0x00, 0x62, 0x62, 0x62, 0x2f, 0x50, 0x4b, 0x03, 0x04, 0x14,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0xb4, 0x04, 0x5d, 0x22, 0x90, 0xae,
+	0xa0, 0x05, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00,
+	0x00, 0x62, 0x62, 0x62, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x33, 0x2e, 0x74,
+	0x78, 0x74, 0x61, 0x68, 0x6f, 0x6a, 0x0a, 0x50, 0x4b, 0x03, 0x04, 0x14,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x32, 0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00,
+	0x00, 0x61, 0x61, 0x61, 0x2f, 0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x32, 0xb4, 0x04, 0x5d, 0xb7, 0xc5, 0x14, 0x13, 0x04,
+	0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00, 0x61,
+	0x61, 0x61, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x32, 0x2e, 0x74, 0x78, 0x74,
+	0x62, 0x79, 0x65, 0x0a, 0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x2d, 0xb4, 0x04, 0x5d, 0x20, 0x30, 0x3a, 0x36, 0x06, 0x00,
+	0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00, 0x61, 0x61,
+	0x61, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x31, 0x2e, 0x74, 0x78, 0x74, 0x68,
+	0x65, 0x6c, 0x6c, 0x6f, 0x0a, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0xed, 0x41, 0x00,
+	0x00, 0x00, 0x00, 0x2e, 0x2f, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0xb4, 0x04, 0x5d, 0xe5, 0x4b, 0x35,
+	0x9a, 0x20, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x0b, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4, 0x81, 0x20,
+	0x00, 0x00, 0x00, 0x61, 0x72, 0x63, 0x68, 0x69, 0x76, 0x65, 0x2e, 0x7a,
+	0x69, 0x70, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x3c, 0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0xed, 0x41, 0x69, 0x00, 0x00, 0x00,
+	0x62, 0x62, 0x62, 0x2f, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x3c, 0xb4, 0x04, 0x5d, 0x22, 0x90, 0xae, 0xa0,
+	0x05, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4, 0x81, 0x8b, 0x00,
+	0x00, 0x00, 0x62, 0x62, 0x62, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x33, 0x2e,
+	0x74, 0x78, 0x74, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x32, 0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0xed, 0x41, 0xbb, 0x00, 0x00,
+	0x00, 0x61, 0x61, 0x61, 0x2f, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x32, 0xb4, 0x04, 0x5d, 0xb7, 0xc5, 0x14,
+	0x13, 0x04, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4, 0x81, 0xdd,
+	0x00, 0x00, 0x00, 0x61, 0x61, 0x61, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x32,
+	0x2e, 0x74, 0x78, 0x74, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x2d, 0xb4, 0x04, 0x5d, 0x20, 0x30, 0x3a, 0x36,
+	0x06, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00,
+	0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4, 0x81, 0x0c, 0x01,
+	0x00, 0x00, 0x61, 0x61, 0x61, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x31, 0x2e,
+	0x74, 0x78, 0x74, 0x50, 0x4b, 0x05, 0x06, 0x00, 0x00, 0x00, 0x00, 0x07,
+	0x00, 0x07, 0x00, 0x7e, 0x01, 0x00, 0x00, 0x3d, 0x01, 0x00, 0x00, 0x00,
+	0x00
+};
+static const unsigned int test_archive_zip_len = 721;
+
+static void test_create_cfg(void);
 static void test_fetch_pages(void);
+static void test_fetch_changed(void);
+static void test_update_pages(void);
 static void test_extract_pages(void);
 static void test_find_page(void);
+static void test_resolve_page(void);
 static void test_print_page(void);
+static void test_print_page_spans(void);
+static void test_markup_scan(void);
+static void test_print_pages(void);
 static void test_list_pages(void);
+static void test_export_pages(void);
+static void test_suggest_pages(void);
+static void test_warm_pages(void);
+static void test_lookup_cost(void);
+static void test_render_cost(void);
+static void lookup_cost(int npages, int ndirs, Cost *c);
+static FILE *counting_stream(unsigned long *writes);
 static int remove_directory(const char *path);
+static int remove_pages(const char *home);
+static int count_files(const char *path);
+static void touch(const char *home, const char *path);
+static void assert_file(const char *path, const char *want);
 
 int
 remove_directory(const char *path)
@@ -83,18 +188,110 @@ remove_directory(const char *path)
 	return ret;
 }
 
+int
+remove_pages(const char *home)
+{
+	const char *suffixes[] = {".index", ".updated", ".lock", ".mirrors",
+	                          ".usage"};
+	char path[PATH_MAX];
+	size_t i;
+
+	/* State files live next to the tree, not inside it. */
+	for (i = 0; i < sizeof(suffixes) / sizeof(suffixes[0]); i++) {
+		snprintf(path, PATH_MAX, "%s%s", home, suffixes[i]);
+		if (unlink(path) == -1 && access(path, F_OK) == 0)
+			return -1;
+	}
+	return remove_directory(home);
+}
+
+int
+count_files(const char *path)
+{
+	char *const paths[] = { (char *)path, NULL };
+	FTS *fts = fts_open(paths, FTS_PHYSICAL | FTS_NOCHDIR, NULL);
+	FTSENT *entry;
+	int n = 0;
+
+	assert(fts != NULL);
+	while ((entry = fts_read(fts)) != NULL)
+		n += (entry->fts_info == FTS_F);
+	fts_close(fts);
+	return n;
+}
+
+void
+touch(const char *home, const char *path)
+{
+	char buf[PATH_MAX];
+	FILE *f;
+
+	snprintf(buf, PATH_MAX, "%s/%s", home, path);
+	f = fopen(buf, "w");
+	assert(f != NULL);
+	assert(fclose(f) == 0);
+}
+
+void
+test_create_cfg(void)
+{
+	ConfigOpts opts = {
+		.pages_url       = "nil",
+		.pages_home      = "nil",
+		.user_agent      = "nil",
+		.heading_style   = "nil",
+		.summary_style   = "nil",
+		.comment_style   = "nil",
+		.command_style   = "nil",
+		.reset_style     = "nil",
+		.max_rate        = 512,
+		.low_speed_limit = 1024,
+		.low_speed_time  = 30,
+		.skip_empty      = -1,
+		.apply_styles    = -1,
+		.out             = NULL,
+	};
+	Config *cfg;
+
+	/* A rate cap below the stall limit would abort every download. */
+	cfg = create_cfg(&opts);
+	assert(cfg != NULL);
+	assert(cfg->max_rate == 512);
+	assert(cfg->low_speed_limit == 256);
+	destroy_cfg(cfg);
+
+	/* A cap above it leaves it alone, as does no cap at all. */
+	opts.max_rate = 4096;
+	cfg = create_cfg(&opts);
+	assert(cfg != NULL);
+	assert(cfg->low_speed_limit == 1024);
+	destroy_cfg(cfg);
+	opts.max_rate = 0;
+	cfg = create_cfg(&opts);
+	assert(cfg != NULL);
+	assert(cfg->low_speed_limit == 1024);
+	destroy_cfg(cfg);
+}
+
 void
 test_fetch_pages(void)
 {
 	char tmpl[] = MKTEMP_TEMPLATE;
+	char sums_tmpl[] = MKTEMP_TEMPLATE;
+	char home[] = MKTEMP_TEMPLATE;
 	char url_buf[PATH_MAX];
+	char sums_url[PATH_MAX];
+	char path_buf[PATH_MAX];
+	char line[PATH_MAX + 32];
 	const char *payload = FETCH_PAYLOAD;
 	const size_t payload_len = strlen(FETCH_PAYLOAD);
 	char *out_buf = calloc(payload_len, sizeof(char));
 	FILE *out = fmemopen(out_buf, payload_len, "rb+");
+	FILE *sums;
+	FetchReport report;
 	Config *cfg;
 	size_t n_written;
-	int fd;
+	int fd, i;
 
 	/* Create temporary file. */
 	fd = mkstemp(tmpl);
@@ -111,6 +308,7 @@ test_fetch_pages(void)
 	/* Fetch payload. */
 	cfg = create_cfg(&(ConfigOpts){
 		.pages_url     = url_buf,
+		.pages_sha256  = FETCH_SHA256,
 		.pages_home    = "nil",
 		.user_agent    = "tinytldr/"GIT_VERSION,
 		.heading_style = "nil",
@@ -123,91 +321,186 @@ test_fetch_pages(void)
 		.out           = NULL,
 	});
 	assert(cfg != NULL);
-	assert(fetch_pages(cfg, out) == 0);
+	assert(fetch_pages(cfg, out, &report) == 0);
+	assert(report.bytes == payload_len);
+	assert(strcmp(report.sha256, FETCH_SHA256) == 0);
+	assert(report.verified == 1);
 
 	/* Verify payload. */
 	rewind(out);
 	assert(memcmp(out_buf, payload, payload_len) == 0);
+	destroy_cfg(cfg);
+
+	/* A wrong checksum must fail the fetch. */
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = url_buf,
+		.pages_sha256  = "00",
+		.pages_home    = "nil",
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	rewind(out);
+	assert(fetch_pages(cfg, out, &report) == -1);
+	assert(report.verified == 0);
+	destroy_cfg(cfg);
+
+	/* Published checksum is looked up by the archive file name. */
+	fd = mkstemp(sums_tmpl);
+	assert(fd > 0);
+	sums = fdopen(fd, "w");
+	assert(sums != NULL);
+	fprintf(sums, "%064d  other.zip\n", 0);
+	fprintf(sums, "%s *%s\n", FETCH_SHA256, strrchr(tmpl, '/') + 1);
+	assert(fclose(sums) == 0);
+	snprintf(sums_url, URL_SIZE, "file://%s", sums_tmpl);
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = url_buf,
+		.sums_url      = sums_url,
+		.pages_home    = "nil",
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	rewind(out);
+	assert(fetch_pages(cfg, out, &report) == 0);
+	assert(report.verified == 1);
+	destroy_cfg(cfg);
+
+	/* No digest for the archive, or no sums file at all, fails closed. */
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "file:///nonexistent/unlisted.zip",
+		.sums_url      = sums_url,
+		.pages_home    = "nil",
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	rewind(out);
+	assert(fetch_pages(cfg, out, &report) == -1);
+	assert(report.verified == 0);
+	destroy_cfg(cfg);
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = url_buf,
+		.sums_url      = "file:///nonexistent.sums",
+		.pages_home    = "nil",
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	rewind(out);
+	assert(fetch_pages(cfg, out, &report) == -1);
+	destroy_cfg(cfg);
+
+	/* Digests that are not 64 hex digits count as none: nothing is
+	 * downloaded, so there is nothing to mismatch. */
+	sums = fopen(sums_tmpl, "w");
+	assert(sums != NULL);
+	fprintf(sums, "%.63s  %s\n", FETCH_SHA256, strrchr(tmpl, '/') + 1);
+	fprintf(sums, "%.63sg  %s\n", FETCH_SHA256, strrchr(tmpl, '/') + 1);
+	fprintf(sums, "%s0  %s\n", FETCH_SHA256, strrchr(tmpl, '/') + 1);
+	assert(fclose(sums) == 0);
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = url_buf,
+		.sums_url      = sums_url,
+		.pages_home    = "nil",
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	rewind(out);
+	assert(fetch_pages(cfg, out, &report) == -1);
+	assert(report.bytes == 0);
+	destroy_cfg(cfg);
+
+	/* A dead mirror falls back to the next source and is remembered. */
+	assert(mkdtemp(home) != NULL);
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = url_buf,
+		.pages_sha256  = FETCH_SHA256,
+		.mirrors       = (const char *[]){"file:///nonexistent.zip", NULL},
+		.pages_home    = home,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	for (i = 0; i < 2; i++) {
+		rewind(out);
+		memset(out_buf, 0, payload_len);
+		assert(fetch_pages(cfg, out, &report) == 0);
+		assert(report.verified == 1);
+		assert(memcmp(out_buf, payload, payload_len) == 0);
+	}
+	snprintf(path_buf, PATH_MAX, "%s.mirrors", home);
+	sums = fopen(path_buf, "r");
+	assert(sums != NULL);
+	assert(fgets(line, sizeof(line), sums) != NULL);
+	assert(strstr(line, url_buf) != NULL);
+	assert(fgets(line, sizeof(line), sums) != NULL);
+	assert(strcmp(line, "0 file:///nonexistent.zip\n") == 0);
+	assert(fclose(sums) == 0);
 
 	/* Clean up. */
 	free(out_buf);
 	destroy_cfg(cfg);
+	assert(remove_pages(home) == 0);
 	assert(fclose(out) == 0);
 	assert(unlink(tmpl) == 0);
+	assert(unlink(sums_tmpl) == 0);
 }
 
 void
 test_extract_pages(void)
 {
-	unsigned char test_archive_zip[] = {
-		0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0xb4,
-		0x04, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x2e, 0x2f, 0x50, 0x4b, 0x03, 0x04,
-		0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0xb4, 0x04, 0x5d, 0xe5, 0x4b,
-		0x35, 0x9a, 0x20, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x0b, 0x00,
-		0x00, 0x00, 0x61, 0x72, 0x63, 0x68, 0x69, 0x76, 0x65, 0x2e, 0x7a, 0x69,
-		0x70, 0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x46,
-		0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x02, 0x00, 0x00, 0x00, 0x2e, 0x2f, 0x50, 0x4b, 0x03,
-		0x04, 0x14, 0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0xb4, 0x04, 0x5d, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04,
-		0x00, 0x00, 0x00, 0x62, 0x62, 0x62, 0x2f, 0x50, 0x4b, 0x03, 0x04, 0x14,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x3c, 0xb4, 0x04, 0x5d, 0x22, 0x90, 0xae,
-		0xa0, 0x05, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00,
-		0x00, 0x62, 0x62, 0x62, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x33, 0x2e, 0x74,
-		0x78, 0x74, 0x61, 0x68, 0x6f, 0x6a, 0x0a, 0x50, 0x4b, 0x03, 0x04, 0x14,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x32, 0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00,
-		0x00, 0x61, 0x61, 0x61, 0x2f, 0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x32, 0xb4, 0x04, 0x5d, 0xb7, 0xc5, 0x14, 0x13, 0x04,
-		0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00, 0x61,
-		0x61, 0x61, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x32, 0x2e, 0x74, 0x78, 0x74,
-		0x62, 0x79, 0x65, 0x0a, 0x50, 0x4b, 0x03, 0x04, 0x14, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x2d, 0xb4, 0x04, 0x5d, 0x20, 0x30, 0x3a, 0x36, 0x06, 0x00,
-		0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00, 0x61, 0x61,
-		0x61, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x31, 0x2e, 0x74, 0x78, 0x74, 0x68,
-		0x65, 0x6c, 0x6c, 0x6f, 0x0a, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0xed, 0x41, 0x00,
-		0x00, 0x00, 0x00, 0x2e, 0x2f, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x46, 0xb4, 0x04, 0x5d, 0xe5, 0x4b, 0x35,
-		0x9a, 0x20, 0x00, 0x00, 0x00, 0x20, 0x00, 0x00, 0x00, 0x0b, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4, 0x81, 0x20,
-		0x00, 0x00, 0x00, 0x61, 0x72, 0x63, 0x68, 0x69, 0x76, 0x65, 0x2e, 0x7a,
-		0x69, 0x70, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x3c, 0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0xed, 0x41, 0x69, 0x00, 0x00, 0x00,
-		0x62, 0x62, 0x62, 0x2f, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x3c, 0xb4, 0x04, 0x5d, 0x22, 0x90, 0xae, 0xa0,
-		0x05, 0x00, 0x00, 0x00, 0x05, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4, 0x81, 0x8b, 0x00,
-		0x00, 0x00, 0x62, 0x62, 0x62, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x33, 0x2e,
-		0x74, 0x78, 0x74, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x32, 0xb4, 0x04, 0x5d, 0x00, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x00, 0xed, 0x41, 0xbb, 0x00, 0x00,
-		0x00, 0x61, 0x61, 0x61, 0x2f, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x32, 0xb4, 0x04, 0x5d, 0xb7, 0xc5, 0x14,
-		0x13, 0x04, 0x00, 0x00, 0x00, 0x04, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4, 0x81, 0xdd,
-		0x00, 0x00, 0x00, 0x61, 0x61, 0x61, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x32,
-		0x2e, 0x74, 0x78, 0x74, 0x50, 0x4b, 0x01, 0x02, 0x14, 0x03, 0x14, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x2d, 0xb4, 0x04, 0x5d, 0x20, 0x30, 0x3a, 0x36,
-		0x06, 0x00, 0x00, 0x00, 0x06, 0x00, 0x00, 0x00, 0x0d, 0x00, 0x00, 0x00,
-		0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xa4, 0x81, 0x0c, 0x01,
-		0x00, 0x00, 0x61, 0x61, 0x61, 0x2f, 0x66, 0x69, 0x6c, 0x65, 0x31, 0x2e,
-		0x74, 0x78, 0x74, 0x50, 0x4b, 0x05, 0x06, 0x00, 0x00, 0x00, 0x00, 0x07,
-		0x00, 0x07, 0x00, 0x7e, 0x01, 0x00, 0x00, 0x3d, 0x01, 0x00, 0x00, 0x00,
-		0x00
-	};
-	unsigned int test_archive_zip_len = 721;
 
 	char tmpl[] = MKTEMP_TEMPLATE;
 	char path_buf[PATH_MAX];
+	struct stat old, st;
 	Config *cfg;
 	FILE *archive;
+	int fd;
 
 	/* Create a temporary directory. */
 	assert(mkdtemp(tmpl) != NULL);
@@ -237,39 +530,55 @@ test_extract_pages(void)
 	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, "/bbb/file3.txt");
 	assert(access(path_buf, F_OK) == 0);
 
+	/* Pages are replaced rather than rewritten, so a reader holding the
+	 * old one keeps it whole, and nothing is left beside them. */
+	fd = open(path_buf, O_RDONLY);
+	assert(fd > 0);
+	assert(fstat(fd, &old) == 0);
+	rewind(archive);
+	assert(extract_pages(cfg, archive) == 0);
+	assert(stat(path_buf, &st) == 0);
+	assert(st.st_ino != old.st_ino);
+	assert(st.st_mode == old.st_mode);
+	assert((st.st_mode & 0600) == 0600 && (st.st_mode & 0044) != 0);
+	assert(fstat(fd, &st) == 0);
+	assert(st.st_size == old.st_size);
+	assert(close(fd) == 0);
+	assert(count_files(tmpl) == 4);
+
 	/* Clean up */
 	assert(fclose(archive) == 0);
-	assert(remove_directory(tmpl) == 0);
+	assert(remove_pages(tmpl) == 0);
 	destroy_cfg(cfg);
 }
 
 void
-test_find_page(void)
+test_fetch_changed(void)
 {
 	char tmpl[] = MKTEMP_TEMPLATE;
+	char zip_tmpl[] = MKTEMP_TEMPLATE;
+	char url_buf[PATH_MAX];
 	char path_buf[PATH_MAX];
+	char got[8] = {0};
+	unsigned char zip[sizeof(test_archive_zip)], *eocd;
+	FetchReport report;
 	Config *cfg;
-	char *found;
-	FILE *f;
+	FILE *delta, *f;
+	int fd;
 
-	/* Create dummy tree structure. */
-	assert(mkdtemp(tmpl) != NULL);
-	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "aaa");
-	assert(mkdir(path_buf, 0755) == 0);
-	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "bbb");
-	assert(mkdir(path_buf, 0755) == 0);
-	/* Create files. */
-	snprintf(path_buf, PATH_MAX, "%s/%s/%s", tmpl, "aaa", "file.txt");
-	f = fopen(path_buf, "w");
-	assert(f != NULL);
-	assert(fclose(f) == 0);
-	snprintf(path_buf, PATH_MAX, "%s/%s/%s", tmpl, "bbb", "file.txt");
-	f = fopen(path_buf, "w");
-	assert(f != NULL);
-	assert(fclose(f) == 0);
+	/* Serve the test archive from a file:// URL; curl honours ranges.
+	 * The mirror was never measured, so it is not asked for any. */
+	fd = mkstemp(zip_tmpl);
+	assert(fd > 0);
+	assert(write(fd, test_archive_zip, test_archive_zip_len) ==
+	       (ssize_t)test_archive_zip_len);
+	assert(close(fd) == 0);
+	snprintf(url_buf, URL_SIZE, "file://%s", zip_tmpl);
 
+	assert(mkdtemp(tmpl) != NULL);
 	cfg = create_cfg(&(ConfigOpts){
-		.pages_url     = "nil",
+		.pages_url     = url_buf,
+		.mirrors       = (const char *[]){"file:///nonexistent.zip", NULL},
 		.pages_home    = tmpl,
 		.user_agent    = "nil",
 		.heading_style = "nil",
@@ -283,70 +592,438 @@ test_find_page(void)
 	});
 	assert(cfg != NULL);
 
-	/* Conduct searches. */
-	found = find_page(cfg, "file.txt", NULL);
-	assert(found != NULL);
-	assert(strncmp(found, path_buf, strlen(path_buf)) != 0);
-	free(found);
+	/* Nothing installed: every file is fetched. */
+	delta = tmpfile();
+	assert(delta != NULL);
+	assert(fetch_changed(cfg, delta, &report) == 0);
+	assert(report.changed == 4);
+	rewind(delta);
+	assert(extract_pages(cfg, delta) == 0);
+	assert(fclose(delta) == 0);
 
-	found = find_page(cfg, "file.txt", "aaa");
-	assert(found != NULL);
-	assert(strncmp(found, path_buf, strlen(path_buf)) != 0);
-	free(found);
+	/* Up to date: nothing but an empty directory. */
+	delta = tmpfile();
+	assert(delta != NULL);
+	assert(fetch_changed(cfg, delta, &report) == 0);
+	assert(report.changed == 0);
+	assert(report.bytes == 0);
+	assert(fclose(delta) == 0);
 
-	found = find_page(cfg, "file.txt", "bbb");
-	assert(found != NULL);
-	assert(strncmp(found, path_buf, strlen(path_buf)) == 0);
-	free(found);
+	/* Edit one page and delete another; only those come back. */
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, "/aaa/file1.txt");
+	f = fopen(path_buf, "w");
+	assert(f != NULL);
+	assert(fputs("edited\n", f) >= 0);
+	assert(fclose(f) == 0);
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, "/bbb/file3.txt");
+	assert(unlink(path_buf) == 0);
 
-	assert(find_page(cfg, "does-not-exist", "bbb") == NULL);
-	assert(find_page(cfg, "does-not-exist!", NULL) == NULL);
+	delta = tmpfile();
+	assert(delta != NULL);
+	assert(fetch_changed(cfg, delta, &report) == 0);
+	assert(report.changed == 2);
+	assert(report.bytes < test_archive_zip_len / 2);
+	rewind(delta);
+	assert(extract_pages(cfg, delta) == 0);
+	assert(fclose(delta) == 0);
+
+	assert(access(path_buf, F_OK) == 0);
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, "/aaa/file1.txt");
+	f = fopen(path_buf, "r");
+	assert(f != NULL);
+	assert(fread(got, 1, sizeof(got) - 1, f) == 6);
+	assert(strcmp(got, "hello\n") == 0);
+	assert(fclose(f) == 0);
+
+	/* An entry placed at the central directory is refused. */
+	memcpy(zip, test_archive_zip, test_archive_zip_len);
+	eocd = zip + test_archive_zip_len - 22;
+	assert(memcmp(eocd, "PK\5\6", 4) == 0);
+	memcpy(zip + eocd[16] + (eocd[17] << 8) + 42, eocd + 16, 4);
+	fd = open(zip_tmpl, O_WRONLY | O_TRUNC);
+	assert(fd > 0);
+	assert(write(fd, zip, test_archive_zip_len) ==
+	       (ssize_t)test_archive_zip_len);
+	assert(close(fd) == 0);
+	delta = tmpfile();
+	assert(delta != NULL);
+	assert(fetch_changed(cfg, delta, &report) == -1);
+	assert(fclose(delta) == 0);
 
 	/* Clean up. */
-	assert(remove_directory(tmpl) == 0);
+	assert(remove_pages(tmpl) == 0);
+	assert(unlink(zip_tmpl) == 0);
 	destroy_cfg(cfg);
 }
 
 void
-test_print_page(void)
+test_update_pages(void)
 {
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char zip_tmpl[] = MKTEMP_TEMPLATE;
+	char url_buf[PATH_MAX];
+	char path_buf[PATH_MAX];
+	struct timespec old[2] = {{0, 0}, {0, 0}};
+	struct flock lock = {.l_type = F_WRLCK, .l_whence = SEEK_SET};
+	FetchReport report;
+	time_t started;
 	Config *cfg;
+	int fd;
 
-	char raw_page[]    = "# heading\n\n> summary\n- comment\n`command`\n";
-	char styled_page[] = "1# heading@\n2> summary@\n3- comment@\n4`command`@\n";
-
-	size_t in_len  = strlen(raw_page);
-	size_t out_len = strlen(styled_page);
-	char *in_buf  = calloc(in_len, sizeof(char));
-	char *out_buf = calloc(out_len, sizeof(char));
-	FILE *in_page;
-	FILE *out_page;
-
-	/* Prepare in and out FILEs. */
-	memcpy(in_buf, raw_page, in_len);
-	in_page  = fmemopen(in_buf, in_len, "rb");
-	out_page = fmemopen(out_buf, out_len, "rb+");
+	fd = mkstemp(zip_tmpl);
+	assert(fd > 0);
+	assert(write(fd, test_archive_zip, test_archive_zip_len) ==
+	       (ssize_t)test_archive_zip_len);
+	assert(close(fd) == 0);
+	snprintf(url_buf, URL_SIZE, "file://%s", zip_tmpl);
 
-	/* Prepare Config. */
+	assert(mkdtemp(tmpl) != NULL);
 	cfg = create_cfg(&(ConfigOpts){
-		.pages_url     = "nil",
-		.pages_home    = "nil",
+		.pages_url     = url_buf,
+		.pages_home    = tmpl,
 		.user_agent    = "nil",
-		.heading_style = "1",
-		.summary_style = "2",
-		.comment_style = "3",
-		.command_style = "4",
-		.reset_style   = "@",
-		.skip_empty    = 1,
-		.apply_styles  = 1,
-		.out           = out_page,
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.delta_update  = 1,
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
 	});
 	assert(cfg != NULL);
-	/* Print page and verify styling. */
-	assert(print_page(cfg, in_page) == 0); /* Print. */
-	assert(fflush(out_page) == 0);
-	assert(memcmp(out_buf, styled_page, out_len) == 0);
-	/* Disable styling and verify. */
+
+	/* Never updated. */
+	assert(pages_age(cfg) == -1);
+	assert(update_pages(cfg, &report) == 0);
+	assert(report.delta == 1);
+	assert(report.changed == 4);
+	assert(pages_age(cfg) >= 0 && pages_age(cfg) < 60);
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, "/bbb/file3.txt");
+	assert(access(path_buf, F_OK) == 0);
+
+	/* Fresh pages: nothing to do. */
+	assert(refresh_pages(cfg, 3600) == 0);
+
+	/* Stale pages are refreshed in the background. */
+	assert(unlink(path_buf) == 0);
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, ".updated");
+	assert(utimensat(AT_FDCWD, path_buf, old, 0) == 0);
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, ".lock");
+	assert(utimensat(AT_FDCWD, path_buf, old, 0) == 0);
+	assert(pages_age(cfg) > 3600);
+	assert(refresh_pages(cfg, 3600) == 0);
+	/* The refresh holds the lock by now; taking it waits for the end. */
+	fd = open(path_buf, O_RDWR);
+	assert(fd != -1);
+	assert(fcntl(fd, F_SETLKW, &lock) == 0);
+	assert(close(fd) == 0);
+	assert(pages_age(cfg) < 60);
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, "/bbb/file3.txt");
+	assert(access(path_buf, F_OK) == 0);
+	destroy_cfg(cfg);
+
+	/* The first update creates the directories leading to the pages. */
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, "/new/pages");
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = url_buf,
+		.pages_home    = path_buf,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.delta_update  = 1,
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	assert(update_pages(cfg, &report) == 0);
+	assert(report.delta == 0);
+	snprintf(path_buf, PATH_MAX, "%s%s", tmpl, "/new/pages/bbb/file3.txt");
+	assert(access(path_buf, F_OK) == 0);
+	destroy_cfg(cfg);
+
+	/* A checksum rules out the unverifiable delta: the whole archive is
+	 * fetched, and this one does not match. */
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = url_buf,
+		.pages_sha256  = "00",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.delta_update  = 1,
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	assert(update_pages(cfg, &report) == -1);
+	assert(report.delta == 0);
+	destroy_cfg(cfg);
+
+	/* Retries give up once the next one would end past the timeout. */
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "file:///nonexistent.zip",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.timeout       = 1,
+		.retries       = 100,
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+	started = time(NULL);
+	assert(update_pages(cfg, &report) == -1);
+	assert(time(NULL) - started < 5);
+
+	/* Clean up. */
+	assert(remove_pages(tmpl) == 0);
+	assert(unlink(zip_tmpl) == 0);
+	destroy_cfg(cfg);
+}
+
+void
+test_find_page(void)
+{
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char path_buf[PATH_MAX], idx_buf[PATH_MAX];
+	Config *cfg;
+	char *found;
+	FILE *f;
+	int fd;
+
+	/* Create dummy tree structure. */
+	assert(mkdtemp(tmpl) != NULL);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "aaa");
+	assert(mkdir(path_buf, 0755) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "bbb");
+	assert(mkdir(path_buf, 0755) == 0);
+	/* Create files. */
+	snprintf(path_buf, PATH_MAX, "%s/%s/%s", tmpl, "aaa", "file.txt");
+	f = fopen(path_buf, "w");
+	assert(f != NULL);
+	assert(fclose(f) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s/%s", tmpl, "bbb", "file.txt");
+	f = fopen(path_buf, "w");
+	assert(f != NULL);
+	assert(fclose(f) == 0);
+
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "nil",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+
+	/* Conduct searches. */
+	found = find_page(cfg, "file.txt", NULL);
+	assert(found != NULL);
+	assert(strncmp(found, path_buf, strlen(path_buf)) != 0);
+	free(found);
+
+	found = find_page(cfg, "file.txt", "aaa");
+	assert(found != NULL);
+	assert(strncmp(found, path_buf, strlen(path_buf)) != 0);
+	free(found);
+
+	found = find_page(cfg, "file.txt", "bbb");
+	assert(found != NULL);
+	assert(strncmp(found, path_buf, strlen(path_buf)) == 0);
+	free(found);
+
+	assert(find_page(cfg, "does-not-exist", "bbb") == NULL);
+	assert(find_page(cfg, "does-not-exist!", NULL) == NULL);
+
+	/* Same answers once an index exists. */
+	found = NULL;
+	assert(suggest_pages(cfg, "file.txt", &found, 1) == 0);
+	found = find_page(cfg, "file.txt", "bbb");
+	assert(found != NULL);
+	assert(strncmp(found, path_buf, strlen(path_buf)) == 0);
+	free(found);
+	found = find_page(cfg, "file.txt", "aaa");
+	assert(found != NULL);
+	free(found);
+	assert(find_page(cfg, "file.txt", "ccc") == NULL);
+	assert(find_page(cfg, "does-not-exist", "bbb") == NULL);
+	assert(find_page(cfg, "does-not-exist!", NULL) == NULL);
+
+	/* A corrupt index is rebuilt rather than read out of bounds: no
+	 * Bloom filter, and names far past the end of the file. */
+	snprintf(idx_buf, PATH_MAX, "%s.index", tmpl);
+	fd = open(idx_buf, O_RDWR);
+	assert(fd != -1);
+	assert(pwrite(fd, &(uint32_t){0}, 4, 36) == 4);
+	assert(pwrite(fd, &(uint32_t){0xffffff00}, 4, 32) == 4);
+	assert(close(fd) == 0);
+	found = find_page(cfg, "file.txt", "bbb");
+	assert(found != NULL);
+	assert(strncmp(found, path_buf, strlen(path_buf)) == 0);
+	free(found);
+	assert(find_page(cfg, "does-not-exist", "bbb") == NULL);
+
+	/* Clean up. */
+	assert(remove_pages(tmpl) == 0);
+	destroy_cfg(cfg);
+}
+
+void
+test_resolve_page(void)
+{
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char path_buf[PATH_MAX];
+	char long_word[NAME_MAX + 1];
+	char *words[4];
+	Config *cfg;
+	char *found;
+	int used;
+
+	/* Create dummy tree structure. */
+	assert(mkdtemp(tmpl) != NULL);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "common");
+	assert(mkdir(path_buf, 0755) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "linux");
+	assert(mkdir(path_buf, 0755) == 0);
+	touch(tmpl, "common/git.md");
+	touch(tmpl, "common/git-commit.md");
+	touch(tmpl, "linux/docker-compose.md");
+
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "nil",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+
+	/* The longest leading run of words wins. */
+	words[0] = "git";
+	words[1] = "commit";
+	words[2] = "--amend";
+	found = resolve_page(cfg, words, 3, NULL, &used);
+	assert(found != NULL);
+	assert(used == 2);
+	snprintf(path_buf, PATH_MAX, "%s/common/git-commit.md", tmpl);
+	assert(strcmp(found, path_buf) == 0);
+	free(found);
+
+	words[1] = "push";
+	found = resolve_page(cfg, words, 3, NULL, &used);
+	assert(found != NULL);
+	assert(used == 1);
+	snprintf(path_buf, PATH_MAX, "%s/common/git.md", tmpl);
+	assert(strcmp(found, path_buf) == 0);
+	free(found);
+
+	/* An exact name takes every word. */
+	found = resolve_page(cfg, words, 1, NULL, &used);
+	assert(found != NULL);
+	assert(used == 1);
+	free(found);
+
+	/* Platform still applies. */
+	words[0] = "docker";
+	words[1] = "compose";
+	words[2] = "up";
+	assert(resolve_page(cfg, words, 3, "common", &used) == NULL);
+	found = resolve_page(cfg, words, 3, "linux", &used);
+	assert(found != NULL);
+	assert(used == 2);
+	free(found);
+
+	/* Words too long for a file name are left out, not overflowed. */
+	memset(long_word, 'x', NAME_MAX);
+	long_word[NAME_MAX] = 0;
+	words[0] = "git";
+	words[1] = long_word;
+	words[2] = long_word;
+	words[3] = long_word;
+	found = resolve_page(cfg, words, 4, NULL, &used);
+	assert(found != NULL);
+	assert(used == 1);
+	free(found);
+	words[0] = long_word;
+	assert(resolve_page(cfg, words, 1, NULL, &used) == NULL);
+
+	words[0] = "nope";
+	words[1] = "git";
+	assert(resolve_page(cfg, words, 2, NULL, &used) == NULL);
+	assert(resolve_page(cfg, words, 0, NULL, &used) == NULL);
+
+	/* Clean up. */
+	assert(remove_pages(tmpl) == 0);
+	destroy_cfg(cfg);
+}
+
+void
+test_print_page(void)
+{
+	Config *cfg;
+
+	char raw_page[]    = "# heading\n\n> summary\n- comment\n`command`\n";
+	char styled_page[] = "1# heading@\n2> summary@\n3- comment@\n4`command`@\n";
+
+	size_t in_len  = strlen(raw_page);
+	size_t out_len = strlen(styled_page);
+	char *in_buf  = calloc(in_len, sizeof(char));
+	char *out_buf = calloc(out_len, sizeof(char));
+	FILE *in_page;
+	FILE *out_page;
+
+	/* Prepare in and out FILEs. */
+	memcpy(in_buf, raw_page, in_len);
+	in_page  = fmemopen(in_buf, in_len, "rb");
+	out_page = fmemopen(out_buf, out_len, "rb+");
+
+	/* Prepare Config. */
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "nil",
+		.pages_home    = "nil",
+		.user_agent    = "nil",
+		.heading_style = "1",
+		.summary_style = "2",
+		.comment_style = "3",
+		.command_style = "4",
+		.reset_style   = "@",
+		.skip_empty    = 1,
+		.apply_styles  = 1,
+		.out           = out_page,
+	});
+	assert(cfg != NULL);
+	/* Print page and verify styling. */
+	assert(print_page(cfg, in_page) == 0); /* Print. */
+	assert(fflush(out_page) == 0);
+	assert(memcmp(out_buf, styled_page, out_len) == 0);
+	/* Disable styling and verify. */
 	destroy_cfg(cfg);
 	cfg = create_cfg(&(ConfigOpts){
 		.pages_url     = "nil",
@@ -376,6 +1053,193 @@ test_print_page(void)
 	free(out_buf);
 }
 
+void
+test_print_page_spans(void)
+{
+	const char raw_page[] =
+		"- Create `tar` archives:\n"
+		"`tar cf {{target.tar}} {{file}}`\n"
+		"`open {{` and `}}`";
+	const char styled_page[] =
+		"3- Create C`tar`@3 archives:@\n"
+		"4`tar cf P{{target.tar}}@4 P{{file}}@4`@\n"
+		"4`open P{{` and `}}@4`@\n";
+	char long_page[1000], long_want[3000];
+	char *out_buf = NULL;
+	size_t i;
+	size_t out_len = 0;
+	FILE *in_page, *out_page;
+	Config *cfg;
+
+	in_page = fmemopen((void *)raw_page, strlen(raw_page), "rb");
+	out_page = open_memstream(&out_buf, &out_len);
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url         = "nil",
+		.pages_home        = "nil",
+		.user_agent        = "nil",
+		.heading_style     = "1",
+		.summary_style     = "2",
+		.comment_style     = "3",
+		.command_style     = "4",
+		.code_style        = "C",
+		.placeholder_style = "P",
+		.reset_style       = "@",
+		.skip_empty        = 1,
+		.apply_styles      = 1,
+		.out               = out_page,
+	});
+	assert(cfg != NULL);
+	assert(print_page(cfg, in_page) == 0);
+	assert(fflush(out_page) == 0);
+	assert(strcmp(out_buf, styled_page) == 0);
+	assert(fclose(in_page) == 0);
+
+	/* A line with more marks than are scanned at a time. */
+	memset(long_page, '`', sizeof(long_page));
+	memcpy(long_page, "# t\n- ", 6);
+	strcpy(long_want, "1# t@\n3- ");
+	for (i = 0; i < (sizeof(long_page) - 6) / 2; i++)
+		strcat(long_want, "C``@3");
+	strcat(long_want, "@\n");
+	in_page = fmemopen(long_page, sizeof(long_page), "rb");
+	assert(in_page != NULL);
+	rewind(out_page);
+	assert(print_page(cfg, in_page) == 0);
+	assert(fflush(out_page) == 0);
+	assert(strcmp(out_buf, long_want) == 0);
+
+	/* Clean up. */
+	assert(fclose(in_page) == 0);
+	assert(fclose(out_page) == 0);
+	destroy_cfg(cfg);
+	free(out_buf);
+}
+
+void
+test_markup_scan(void)
+{
+	const char alphabet[] = "ab\n`{}";
+	char buf[300];
+	Mark want[sizeof(buf)], got[sizeof(buf) + 2 * MARKUP_MIN];
+	size_t len, room, pos, n, m, k, i;
+	unsigned seed = 1;
+	int round, path;
+
+#if defined(__x86_64__)
+	/* Every x86-64 CPU has SSE2, so that path is always tested. */
+	pos = 0;
+	assert(markup_scan_path(SCAN_SSE2, "", 0, &pos, got, MARKUP_MIN) == 0);
+#endif
+
+	/* Random pages of every length across the vector block sizes, tails
+	 * of every length included, through every path this CPU has, with
+	 * room for all marks at once or a few at a time. */
+	for (round = 0; round < 2000; round++) {
+		len = (size_t)round % sizeof(buf);
+		for (i = 0; i < len; i++) {
+			seed = seed * 1103515245 + 12345;
+			buf[i] = alphabet[(seed >> 16) % (sizeof(alphabet) - 1)];
+		}
+		pos = 0;
+		n = markup_scan_path(SCAN_SCALAR, buf, len, &pos, want, sizeof(buf));
+		assert(pos == len);
+		assert(markup_scan(buf, len, got) == n);
+		room = (round % 2) ? sizeof(buf) : MARKUP_MIN + (size_t)round % 32;
+		/* The last round is the dispatched markup_scan_from(). */
+		for (path = SCAN_SCALAR; path <= SCAN_AVX2 + 1; path++) {
+			m = pos = 0;
+			do {
+				k = (path > SCAN_AVX2) ?
+				    markup_scan_from(buf, len, &pos, got + m, room) :
+				    markup_scan_path(path, buf, len, &pos, got + m, room);
+				if (k == (size_t)-1)
+					break; /* Not on this build or CPU. */
+				m += k;
+			} while (pos < len);
+			if (k == (size_t)-1)
+				continue;
+			assert(pos == len);
+			assert(m == n);
+			for (i = 0; i < n; i++) {
+				assert(got[i].pos == want[i].pos);
+				assert(got[i].kind == want[i].kind);
+			}
+		}
+	}
+
+	/* Pairs never overlap, across a block boundary too. */
+	memset(buf, 'a', sizeof(buf));
+	memcpy(buf + 30, "{{{}}}", 6);
+	n = markup_scan(buf, 64, got);
+	assert(n == 2);
+	assert(got[0].pos == 30 && got[0].kind == MARK_OPEN);
+	assert(got[1].pos == 33 && got[1].kind == MARK_CLOSE);
+}
+
+void
+test_print_pages(void)
+{
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char *paths[40];
+	char want[40 * 16] = {0}, line[16];
+	char *got_buf = NULL;
+	size_t got_len = 0, i;
+	FILE *got_file, *f;
+	Config *cfg;
+
+	/* More pages than readers, each with its own content. */
+	assert(mkdtemp(tmpl) != NULL);
+	for (i = 0; i < 40; i++) {
+		paths[i] = malloc(PATH_MAX);
+		assert(paths[i] != NULL);
+		snprintf(paths[i], PATH_MAX, "%s/page%zu.md", tmpl, i);
+		f = fopen(paths[i], "w");
+		assert(f != NULL);
+		fprintf(f, "# page%zu\n\n", i);
+		assert(fclose(f) == 0);
+		snprintf(line, sizeof(line), "1# page%zu@\n", i);
+		strcat(want, line);
+	}
+	got_file = open_memstream(&got_buf, &got_len);
+	assert(got_file != NULL);
+
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "nil",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "1",
+		.summary_style = "2",
+		.comment_style = "3",
+		.command_style = "4",
+		.reset_style   = "@",
+		.skip_empty    = 1,
+		.apply_styles  = 1,
+		.out           = got_file,
+	});
+	assert(cfg != NULL);
+
+	/* Output keeps the requested order. */
+	assert(print_pages(cfg, paths, 40) == 0);
+	assert(fflush(got_file) == 0);
+	assert(got_len == strlen(want));
+	assert(memcmp(got_buf, want, got_len) == 0);
+
+	/* A missing page fails the call, but the rest are still printed. */
+	rewind(got_file);
+	strcpy(paths[1] + strlen(paths[1]) - 3, ".nil");
+	assert(print_pages(cfg, paths, 3) == -1);
+	assert(fflush(got_file) == 0);
+	assert(memcmp(got_buf, "1# page0@\n1# page2@\n", 20) == 0);
+
+	/* Clean up. */
+	assert(fclose(got_file) == 0);
+	free(got_buf);
+	for (i = 0; i < 40; i++)
+		free(paths[i]);
+	destroy_cfg(cfg);
+	assert(remove_pages(tmpl) == 0);
+}
+
 void
 test_list_pages(void)
 {
@@ -431,16 +1295,482 @@ test_list_pages(void)
 	fclose(got_file);
 	free(got_buf);
 	destroy_cfg(cfg);
-	remove_directory(tmpl);
+	remove_pages(tmpl);
+}
+
+void
+test_export_pages(void)
+{
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char path_buf[PATH_MAX];
+	char *got_buf = NULL;
+	size_t got_len = 0;
+	FILE *got_file, *f;
+	Config *cfg;
+
+	const char *want_json =
+		"[\n"
+		"{\"name\": \"tar\", \"platform\": \"aaa\", "
+		"\"body\": \"# tar\\n\\n`tar \\\"a<b\\\"`\\n\"},\n"
+		"{\"name\": \"cp\", \"platform\": \"bbb\", \"body\": \"> cp\\n\"}\n"
+		"]\n";
+	const char *want_text = "# tar\n`tar \"a<b\"`\n\n> cp\n";
+
+	/* Create dummy tree structure. */
+	assert(mkdtemp(tmpl) != NULL);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "aaa");
+	assert(mkdir(path_buf, 0755) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "bbb");
+	assert(mkdir(path_buf, 0755) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "bbb/cp.md");
+	f = fopen(path_buf, "w");
+	assert(f != NULL);
+	fputs("> cp\n", f);
+	assert(fclose(f) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "aaa/tar.md");
+	f = fopen(path_buf, "w");
+	assert(f != NULL);
+	fputs("# tar\n\n`tar \"a<b\"`\n", f);
+	assert(fclose(f) == 0);
+	touch(tmpl, "aaa/notes.txt");
+
+	got_file = open_memstream(&got_buf, &got_len);
+	assert(got_file != NULL);
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "nil",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "1",
+		.summary_style = "2",
+		.comment_style = "3",
+		.command_style = "4",
+		.reset_style   = "@",
+		.skip_empty    = 1,
+		.apply_styles  = 1,
+		.out           = got_file,
+	});
+	assert(cfg != NULL);
+
+	/* Sorted by platform, raw bodies, escaped. */
+	assert(export_pages(cfg, EXPORT_JSON) == 0);
+	assert(got_len == strlen(want_json));
+	assert(memcmp(got_buf, want_json, got_len) == 0);
+
+	/* Plain text ignores apply_styles. */
+	rewind(got_file);
+	assert(export_pages(cfg, EXPORT_TEXT) == 0);
+	assert(got_len == strlen(want_text));
+	assert(memcmp(got_buf, want_text, got_len) == 0);
+
+	rewind(got_file);
+	assert(export_pages(cfg, EXPORT_HTML) == 0);
+	assert(strstr(got_buf, "<section id=\"aaa/tar.md\">\n<h1>tar</h1>\n"
+	                       "<pre><code>tar &quot;a&lt;b&quot;</code></pre>\n"
+	                       "</section>\n<section id=\"bbb/cp.md\">") != NULL);
+
+	/* Clean up. */
+	assert(fclose(got_file) == 0);
+	free(got_buf);
+	destroy_cfg(cfg);
+	assert(remove_pages(tmpl) == 0);
+}
+
+void
+assert_file(const char *path, const char *want)
+{
+	char got[4096] = {0};
+	FILE *f;
+
+	f = fopen(path, "r");
+	assert(f != NULL);
+	fread(got, 1, sizeof(got) - 1, f);
+	assert(fclose(f) == 0);
+	assert(strcmp(got, want) == 0);
+}
+
+void
+test_suggest_pages(void)
+{
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char path_buf[PATH_MAX];
+	char *list[3], *found;
+	char long_name[NAME_MAX * 2];
+	Config *cfg;
+	int i, n;
+
+	/* Create dummy tree structure. */
+	assert(mkdtemp(tmpl) != NULL);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "common");
+	assert(mkdir(path_buf, 0755) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "linux");
+	assert(mkdir(path_buf, 0755) == 0);
+	touch(tmpl, "common/git-commit.md");
+	touch(tmpl, "common/git-config.md");
+	touch(tmpl, "common/gist.md");
+	touch(tmpl, "common/tar.md");
+	touch(tmpl, "linux/tar.md");
+
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "nil",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = NULL,
+	});
+	assert(cfg != NULL);
+
+	/* Closest first, extension stripped. */
+	n = suggest_pages(cfg, "git-comit.md", list, 3);
+	assert(n >= 1);
+	assert(strcmp(list[0], "git-commit") == 0);
+	for (i = 0; i < n; i++)
+		free(list[i]);
+
+	/* Names present on several platforms are suggested once. */
+	n = suggest_pages(cfg, "tra.md", list, 3);
+	assert(n == 1);
+	assert(strcmp(list[0], "tar") == 0);
+	free(list[0]);
+
+	assert(suggest_pages(cfg, "zzzzzzzz.md", list, 3) == 0);
+
+	/* Names too long to measure are far from every page. */
+	memset(long_name, 'g', sizeof(long_name) - 1);
+	long_name[sizeof(long_name) - 1] = 0;
+	assert(suggest_pages(cfg, long_name, list, 3) == 0);
+
+	/* A page added by hand after the index was built is picked up by the
+	 * miss that suggests it, and found from then on. */
+	touch(tmpl, "linux/git-commits.md");
+	n = suggest_pages(cfg, "git-commitz.md", list, 3);
+	assert(n == 2);
+	assert(strcmp(list[0], "git-commit") == 0);
+	assert(strcmp(list[1], "git-commits") == 0);
+	for (i = 0; i < n; i++)
+		free(list[i]);
+	found = find_page(cfg, "git-commits.md", "linux");
+	assert(found != NULL);
+	free(found);
+
+	/* Clean up. */
+	assert(remove_pages(tmpl) == 0);
+	destroy_cfg(cfg);
+}
+
+void
+test_warm_pages(void)
+{
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char path_buf[PATH_MAX], log[PATH_MAX];
+	FILE *out, *archive;
+	Config *cfg;
+	int i;
+
+	/* Create dummy tree structure. */
+	assert(mkdtemp(tmpl) != NULL);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "common");
+	assert(mkdir(path_buf, 0755) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "linux");
+	assert(mkdir(path_buf, 0755) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "common/git.md");
+	out = fopen(path_buf, "w");
+	assert(out != NULL);
+	assert(fputs("# git\n", out) != EOF);
+	assert(fclose(out) == 0);
+	touch(tmpl, "common/tar.md");
+	touch(tmpl, "linux/tar.md");
+	snprintf(log, PATH_MAX, "%s.usage", tmpl);
+	out = fopen("/dev/null", "w");
+	assert(out != NULL);
+
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "nil",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.track_usage   = 1,
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = out,
+	});
+	assert(cfg != NULL);
+
+	/* Nothing used yet, nothing to warm. */
+	assert(warm_pages(cfg) == 0);
+
+	/* Every page shown is logged; a missing one is not. */
+	for (i = 0; i < 3; i++) {
+		snprintf(path_buf, PATH_MAX, "%s/common/git.md", tmpl);
+		assert(show_page(cfg, path_buf) == 0);
+	}
+	snprintf(path_buf, PATH_MAX, "%s/linux/tar.md", tmpl);
+	assert(show_page(cfg, path_buf) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/linux/nil.md", tmpl);
+	assert(show_page(cfg, path_buf) == -1);
+	assert_file(log, "1 common/git.md\n1 common/git.md\n"
+	                 "1 common/git.md\n1 linux/tar.md\n");
+	assert(warm_pages(cfg) == 2);
+
+	/* Updates fold the log, most used first, and drop pages that are
+	 * gone; hot pages are rewritten intact. */
+	snprintf(path_buf, PATH_MAX, "%s/linux/tar.md", tmpl);
+	assert(unlink(path_buf) == 0);
+	archive = fmemopen((void *)test_archive_zip, test_archive_zip_len, "rb");
+	assert(archive != NULL);
+	assert(extract_pages(cfg, archive) == 0);
+	assert(fclose(archive) == 0);
+	assert_file(log, "3 common/git.md\n");
+	snprintf(path_buf, PATH_MAX, "%s/common/git.md", tmpl);
+	assert_file(path_buf, "# git\n");
+	assert(warm_pages(cfg) == 1);
+
+	/* Clean up. */
+	assert(fclose(out) == 0);
+	assert(remove_pages(tmpl) == 0);
+	destroy_cfg(cfg);
+}
+
+#ifdef __GLIBC__
+static ssize_t
+count_write(void *cookie, const char *buf, size_t n)
+{
+	(void)buf;
+	++*(unsigned long *)cookie;
+	return (ssize_t)n;
+}
+#else
+static int
+count_write(void *cookie, const char *buf, int n)
+{
+	(void)buf;
+	++*(unsigned long *)cookie;
+	return n;
+}
+#endif /* __GLIBC__ */
+
+FILE *
+counting_stream(unsigned long *writes)
+{
+	FILE *f;
+
+	/* Every call of count_write() is a write(2) a real file would get. */
+	*writes = 0;
+#ifdef __GLIBC__
+	f = fopencookie(writes, "w", (cookie_io_functions_t){ .write = count_write });
+#else
+	f = funopen(writes, NULL, count_write, NULL, NULL);
+#endif /* __GLIBC__ */
+	assert(f != NULL);
+	assert(setvbuf(f, NULL, _IOFBF, OUT_BUF) == 0);
+	return f;
+}
+
+void
+lookup_cost(int npages, int ndirs, Cost *c)
+{
+	const char *platforms[] = {"common", "linux", "osx", "windows"};
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char path_buf[PATH_MAX];
+	char dir_buf[NAME_MAX];
+	char *words[] = {"git", "commit", "--amend"};
+	Config *cfg;
+	char *found;
+	FILE *out;
+	int i, used;
+
+	/* Create dummy tree structure. */
+	assert(mkdtemp(tmpl) != NULL);
+	for (i = 0; i < ndirs; i++) {
+		if (i < 4)
+			snprintf(dir_buf, NAME_MAX, "%s", platforms[i]);
+		else
+			snprintf(dir_buf, NAME_MAX, "d%d", i);
+		snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, dir_buf);
+		assert(mkdir(path_buf, 0755) == 0);
+	}
+	for (i = 0; i < npages; i++) {
+		if (i % ndirs < 4)
+			snprintf(path_buf, PATH_MAX, "%s/p%d.md",
+			         platforms[i % ndirs], i);
+		else
+			snprintf(path_buf, PATH_MAX, "d%d/p%d.md", i % ndirs, i);
+		touch(tmpl, path_buf);
+	}
+	touch(tmpl, "common/git.md");
+	touch(tmpl, "common/git-commit.md");
+	assert((out = fopen("/dev/null", "w")) != NULL);
+
+	cfg = create_cfg(&(ConfigOpts){
+		.pages_url     = "nil",
+		.pages_home    = tmpl,
+		.user_agent    = "nil",
+		.heading_style = "nil",
+		.summary_style = "nil",
+		.comment_style = "nil",
+		.command_style = "nil",
+		.reset_style   = "nil",
+		.skip_empty    = -1,
+		.apply_styles  = -1,
+		.out           = out,
+	});
+	assert(cfg != NULL);
+
+	/* Listing reads every entry once. */
+	cost_reset();
+	assert(list_pages(cfg) == 0);
+	assert(cost.dirents == (unsigned long)(npages + 2 + ndirs));
+	assert(cost.bytes == 0);
+
+	/* The first lookup walks once more to build the index and saves it. */
+	cost_reset();
+	found = find_page(cfg, "git.md", NULL);
+	assert(found != NULL);
+	free(found);
+	assert(cost.dirents == (unsigned long)(npages + 2 + ndirs));
+	assert(cost.writes == 1);
+
+	/* After that: hits, misses, platforms and several words alike. */
+	cost_reset();
+	found = find_page(cfg, "p1.md", "linux");
+	assert(found != NULL);
+	free(found);
+	assert(find_page(cfg, "p1.md", "osx") == NULL);
+	assert(find_page(cfg, "nope.md", NULL) == NULL);
+	found = resolve_page(cfg, words, 3, NULL, &used);
+	assert(found != NULL && used == 2);
+	free(found);
+	*c = cost;
+
+	/* Clean up. */
+	assert(remove_pages(tmpl) == 0);
+	destroy_cfg(cfg);
+	fclose(out);
+}
+
+void
+test_lookup_cost(void)
+{
+	Cost small, big;
+
+	lookup_cost(50, 5, &small);
+	lookup_cost(5000, 100, &big);
+
+	/* One index open per lookup and no walk, at any size. */
+	assert(small.dirents == 0);
+	assert(small.opens == 4);
+	assert(small.bytes == 0);
+	assert(small.writes == 0);
+	assert(big.dirents == small.dirents);
+	assert(big.opens == small.opens);
+	assert(big.bytes == small.bytes);
+	assert(big.writes == small.writes);
+
+	/* One freshness stamp per open, however many directories there are. */
+	assert(small.stats == small.opens);
+	assert(big.stats == small.stats);
+
+	/* Searches, not scans: 100 times the pages costs each of the four
+	 * lookups under log2(100) < 7 more probes. */
+	assert(small.probes > 0);
+	assert(big.probes <= small.probes + 4 * 7);
+}
+
+void
+test_render_cost(void)
+{
+	char tmpl[] = MKTEMP_TEMPLATE;
+	char path_buf[PATH_MAX];
+	const int sizes[] = {10, 1000};
+	unsigned long writes;
+	struct stat st;
+	Config *cfg;
+	FILE *out, *f;
+	int i, j;
+
+	assert(mkdtemp(tmpl) != NULL);
+	snprintf(path_buf, PATH_MAX, "%s/%s", tmpl, "common");
+	assert(mkdir(path_buf, 0755) == 0);
+	snprintf(path_buf, PATH_MAX, "%s/common/big.md", tmpl);
+
+	for (i = 0; i < 2; i++) {
+		/* A page of sizes[i] examples, markup on every line. */
+		assert((f = fopen(path_buf, "w")) != NULL);
+		fprintf(f, "# big\n\n> Summary with `code`.\n\n");
+		for (j = 0; j < sizes[i]; j++)
+			fprintf(f, "- Example %d:\n\n`big {{arg%d}}`\n\n", j, j);
+		assert(fclose(f) == 0);
+		assert(stat(path_buf, &st) == 0);
+
+		out = counting_stream(&writes);
+		cfg = create_cfg(&(ConfigOpts){
+			.pages_url         = "nil",
+			.pages_home        = tmpl,
+			.user_agent        = "nil",
+			.heading_style     = "1",
+			.summary_style     = "2",
+			.comment_style     = "3",
+			.command_style     = "4",
+			.code_style        = "5",
+			.placeholder_style = "6",
+			.reset_style       = "@",
+			.skip_empty        = 1,
+			.apply_styles      = 1,
+			.out               = out,
+		});
+		assert(cfg != NULL);
+
+		/* One open, one pass over the bytes. */
+		cost_reset();
+		assert(show_page(cfg, path_buf) == 0);
+		assert(fflush(out) == 0);
+		assert(cost.opens == 1);
+		assert(cost.bytes == (unsigned long long)st.st_size);
+		assert(cost.writes == 0);
+
+		/* Output leaves in buffer-sized writes, not a write per line:
+		 * at most a flush and a direct write per buffer. */
+		assert(writes >= 1);
+		assert(writes <= 2 * ((unsigned long)st.st_size * 2 / OUT_BUF) + 2);
+		if (sizes[i] == 10)
+			assert(writes == 1);
+
+		destroy_cfg(cfg);
+		fclose(out);
+	}
+
+	/* Clean up. */
+	assert(remove_pages(tmpl) == 0);
 }
 
 int
 main(void)
 {
+	test_create_cfg();
 	test_fetch_pages();
 	test_extract_pages();
+	test_fetch_changed();
+	test_update_pages();
 	test_find_page();
+	test_resolve_page();
 	test_print_page();
+	test_print_page_spans();
+	test_markup_scan();
+	test_print_pages();
 	test_list_pages();
+	test_export_pages();
+	test_suggest_pages();
+	test_warm_pages();
+	test_lookup_cost();
+	test_render_cost();
 	return 0;
 }
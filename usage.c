@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* Page usage log. Every display appends a "1 platform/name.md" line, and
+ * updates fold it into one "count page" line per page, most used first,
+ * so it stays about as large as the set of pages ever read.
+ * A short write() with O_APPEND does not interleave with others, so there
+ * is no locking; a use logged while the log is being replaced may be lost,
+ * which only costs a count. */
+
+/* Includes */
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "cost.h"
+#include "usage.h"
+
+/* Function prototypes */
+static int page_cmp(const void *a, const void *b);
+static int count_cmp(const void *a, const void *b);
+
+int
+page_cmp(const void *a, const void *b)
+{
+	return strcmp(((const Usage *)a)->page, ((const Usage *)b)->page);
+}
+
+int
+count_cmp(const void *a, const void *b)
+{
+	const Usage *x = a, *y = b;
+
+	if (x->count != y->count)
+		return (x->count < y->count) - (x->count > y->count);
+	return strcmp(x->page, y->page);
+}
+
+int
+usage_record(const char *log, const char *page)
+{
+	char line[PATH_MAX + 4];
+	int fd, n, r = 0;
+
+	if (strchr(page, '\n') != NULL)
+		return -1;
+	n = snprintf(line, sizeof(line), "1 %s\n", page);
+	if (n < 0 || (size_t)n >= sizeof(line))
+		return -1;
+
+	/* One write, so concurrent uses land as whole lines. */
+	COST_ADD(opens, 1);
+	if ((fd = open(log, O_WRONLY | O_APPEND | O_CREAT, 0644)) == -1)
+		return -1;
+	COST_ADD(writes, 1);
+	if (write(fd, line, n) != n)
+		r = -1;
+	if (close(fd) == -1)
+		r = -1;
+	return r;
+}
+
+int
+usage_load(const char *log, Usage **u, size_t *n)
+{
+	char *line = NULL, *end;
+	size_t size = 0, cap = 0, i, j;
+	unsigned long count;
+	ssize_t len;
+	Usage *tmp;
+	FILE *f;
+
+	*u = NULL;
+	*n = 0;
+	if ((f = fopen(log, "r")) == NULL)
+		return (errno == ENOENT) ? 0 : -1;
+
+	while ((len = getline(&line, &size, f)) != -1) {
+		if (len > 0 && line[len - 1] == '\n')
+			line[--len] = 0;
+		/* Skip a line torn by a crash or anything not ours. */
+		errno = 0;
+		count = strtoul(line, &end, 10);
+		if (end == line || *end != ' ' || end[1] == 0 || errno != 0)
+			continue;
+		if (*n == cap) {
+			cap = cap ? cap * 2 : 64;
+			if ((tmp = realloc(*u, cap * sizeof(**u))) == NULL)
+				goto fail;
+			*u = tmp;
+		}
+		if (((*u)[*n].page = strdup(end + 1)) == NULL)
+			goto fail;
+		(*u)[(*n)++].count = count;
+	}
+	if (ferror(f))
+		goto fail;
+	free(line);
+	fclose(f);
+
+	/* Fold every page into a single entry. */
+	qsort(*u, *n, sizeof(**u), page_cmp);
+	for (i = j = 0; i < *n; i++) {
+		if (j > 0 && strcmp((*u)[j - 1].page, (*u)[i].page) == 0) {
+			count = (*u)[j - 1].count + (*u)[i].count;
+			(*u)[j - 1].count = (count < (*u)[i].count) ? ULONG_MAX : count;
+			free((*u)[i].page);
+		} else {
+			(*u)[j++] = (*u)[i];
+		}
+	}
+	*n = j;
+	qsort(*u, *n, sizeof(**u), count_cmp);
+	return 0;
+
+fail:
+	free(line);
+	fclose(f);
+	usage_free(*u, *n);
+	*u = NULL;
+	*n = 0;
+	return -1;
+}
+
+int
+usage_save(const char *log, const Usage *u, size_t n)
+{
+	char tmp[PATH_MAX + 8];
+	size_t i;
+	FILE *f;
+	int fd, r;
+
+	if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", log) >= (int)sizeof(tmp))
+		return -1;
+	if ((fd = mkstemp(tmp)) == -1)
+		return -1;
+	if ((f = fdopen(fd, "w")) == NULL) {
+		close(fd);
+		unlink(tmp);
+		return -1;
+	}
+	for (i = 0; i < n; i++)
+		fprintf(f, "%lu %s\n", u[i].count, u[i].page);
+	r = fchmod(fd, 0644);
+	if (fclose(f) == EOF || r == -1 || rename(tmp, log) == -1) {
+		unlink(tmp);
+		return -1;
+	}
+	return 0;
+}
+
+void
+usage_free(Usage *u, size_t n)
+{
+	while (n > 0)
+		free(u[--n].page);
+	free(u);
+}
@@ -0,0 +1,26 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+#ifndef USAGE_H
+#define USAGE_H
+
+#include <stddef.h>
+
+#define USAGE_SUFFIX ".usage" /* Kept next to the pages. */
+#define USAGE_HOT 64          /* The most used pages are hot. */
+
+typedef struct {
+	char *page;             /* Relative to home, e.g. "common/tar.md". */
+	unsigned long count;
+} Usage;
+
+/* Append one use of page to the log. */
+int usage_record(const char *log, const char *page);
+/* Read the log, one entry per page, most used first. A missing log is
+ * empty. */
+int usage_load(const char *log, Usage **u, size_t *n);
+/* Replace the log with these entries. */
+int usage_save(const char *log, const Usage *u, size_t n);
+/* Release what usage_load() returned. */
+void usage_free(Usage *u, size_t n);
+
+#endif /* USAGE_H */
@@ -0,0 +1,378 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+
+/* Parallel directory traversal. Workers pop directories off a shared
+ * stack, open them relative to the root with openat(), and read them with
+ * readdir(), which is a thin layer over getdents64() on Linux. File types
+ * come from d_type, so only symlinks and file systems without d_type cost a
+ * stat. Results are sorted once at the end, so the order matches what a
+ * sorted fts(3) walk would have produced. */
+
+#define _DEFAULT_SOURCE /* DT_* constants on glibc. */
+
+/* Includes */
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include "cost.h"
+#include "walk.h"
+
+/* Constants and Macros */
+#define MAX_WALKERS 16
+
+/* Typedefs */
+/* A directory being read, linked to the one it was found in. */
+typedef struct DirId {
+	dev_t dev;
+	ino_t ino;
+	struct DirId *up;        /* Parent directory; NULL for the root. */
+	struct DirId *next;      /* Every DirId, for freeing. */
+} DirId;
+
+typedef struct {
+	char *rel;
+	DirId *up;
+} Pending;
+
+typedef struct {
+	int root_fd;
+	Walk *w;
+	size_t cap_files, cap_dirs;
+	Pending *stack;          /* Directories waiting to be read. */
+	size_t nstack, cap_stack;
+	size_t busy;             /* Directories being read right now. */
+	DirId *ids;
+	int failed;
+	pthread_mutex_t mu;
+	pthread_cond_t cv;
+} Walker;
+
+/* Function prototypes */
+static int grow(void *arrp, size_t *cap, size_t n, size_t size);
+static int ent_cmp(const void *a, const void *b);
+static char *join(const char *dir, const char *name);
+static int push_dir(Walker *wk, char *rel, DirId *up);
+static void read_dir(Walker *wk, char *rel, DirId *up);
+static void *walker(void *arg);
+
+int
+grow(void *arrp, size_t *cap, size_t n, size_t size)
+{
+	void **arr = arrp, *p;
+	size_t c = *cap ? *cap : 64;
+
+	if (n < *cap)
+		return 0;
+	while (c <= n)
+		c *= 2;
+	if ((p = realloc(*arr, c * size)) == NULL)
+		return -1;
+	*arr = p;
+	*cap = c;
+	return 0;
+}
+
+int
+walk_pathcmp(const char *a, const char *b)
+{
+	size_t la, lb;
+	int r;
+
+	for (;;) {
+		la = strcspn(a, "/");
+		lb = strcspn(b, "/");
+		r = strncmp(a, b, la < lb ? la : lb);
+		if (r != 0)
+			return r;
+		if (la != lb)
+			return (la < lb) ? -1 : 1;
+		if (a[la] == 0 || b[lb] == 0)
+			return (a[la] != 0) - (b[lb] != 0);
+		a += la + 1;
+		b += lb + 1;
+	}
+}
+
+int
+ent_cmp(const void *a, const void *b)
+{
+	return walk_pathcmp(((const WalkEnt *)a)->path, ((const WalkEnt *)b)->path);
+}
+
+char *
+join(const char *dir, const char *name)
+{
+	size_t ld = strlen(dir), ln = strlen(name);
+	char *p;
+
+	if ((p = malloc(ld + ln + 2)) == NULL)
+		return NULL;
+	if (ld > 0) {
+		memcpy(p, dir, ld);
+		p[ld++] = '/';
+	}
+	memcpy(p + ld, name, ln + 1);
+	return p;
+}
+
+int
+push_dir(Walker *wk, char *rel, DirId *up)
+{
+	pthread_mutex_lock(&wk->mu);
+	if (grow(&wk->stack, &wk->cap_stack, wk->nstack, sizeof(Pending)) == -1) {
+		wk->failed = 1;
+		pthread_mutex_unlock(&wk->mu);
+		free(rel);
+		return -1;
+	}
+	wk->stack[wk->nstack].rel = rel;
+	wk->stack[wk->nstack++].up = up;
+	pthread_cond_signal(&wk->cv);
+	pthread_mutex_unlock(&wk->mu);
+	return 0;
+}
+
+void
+read_dir(Walker *wk, char *rel, DirId *up)
+{
+	WalkEnt *files = NULL, *e;
+	DirId *id, *anc;
+	size_t nfiles = 0, cap = 0, i;
+	struct dirent *de;
+	struct stat st;
+	char *child;
+	DIR *d;
+	int fd, is_dir, is_reg, failed = 0;
+
+	fd = openat(wk->root_fd, *rel ? rel : ".", O_RDONLY|O_DIRECTORY);
+	COST_ADD(opens, 1);
+	if (fd == -1 || fstat(fd, &st) == -1) {
+		if (fd != -1)
+			close(fd);
+		free(rel);
+		return; /* Unreadable; fts would skip it too. */
+	}
+
+	/* Skip a symlink back to an ancestor, like FTS_DC. Other links to
+	 * directories seen elsewhere are walked again, as fts does. */
+	for (anc = up; anc != NULL; anc = anc->up)
+		if (anc->dev == st.st_dev && anc->ino == st.st_ino)
+			break;
+	if (anc != NULL || (id = malloc(sizeof(*id))) == NULL) {
+		close(fd);
+		free(rel);
+		return;
+	}
+	id->dev = st.st_dev;
+	id->ino = st.st_ino;
+	id->up = up;
+
+	pthread_mutex_lock(&wk->mu);
+	id->next = wk->ids;
+	wk->ids = id;
+	if (grow(&wk->w->dirs, &wk->cap_dirs, wk->w->ndirs, sizeof(WalkEnt)) == -1) {
+		wk->failed = 1;
+		pthread_mutex_unlock(&wk->mu);
+		close(fd);
+		free(rel);
+		return;
+	}
+	e = &wk->w->dirs[wk->w->ndirs++];
+	e->path = rel;
+	e->name = strrchr(rel, '/') ? strrchr(rel, '/') + 1 : rel;
+	e->sec = st.st_mtim.tv_sec;
+	e->nsec = st.st_mtim.tv_nsec;
+	pthread_mutex_unlock(&wk->mu);
+
+	if ((d = fdopendir(fd)) == NULL) {
+		close(fd);
+		return;
+	}
+	while ((de = readdir(d)) != NULL) {
+		if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+			continue;
+		COST_ADD(dirents, 1);
+#ifdef DT_DIR
+		is_dir = de->d_type == DT_DIR;
+		is_reg = de->d_type == DT_REG;
+		if (de->d_type == DT_LNK || de->d_type == DT_UNKNOWN)
+#endif
+		{
+			/* Follow symlinks, like FTS_LOGICAL. */
+			if (fstatat(dirfd(d), de->d_name, &st, 0) == -1)
+				continue;
+			is_dir = S_ISDIR(st.st_mode);
+			is_reg = S_ISREG(st.st_mode);
+		}
+		if (!is_dir && !is_reg)
+			continue;
+		if ((child = join(rel, de->d_name)) == NULL) {
+			failed = 1;
+			break;
+		}
+		if (is_dir) {
+			push_dir(wk, child, id);
+			continue;
+		}
+		if (grow(&files, &cap, nfiles, sizeof(WalkEnt)) == -1) {
+			free(child);
+			failed = 1;
+			break;
+		}
+		files[nfiles].path = child;
+		files[nfiles].name = child + strlen(child) - strlen(de->d_name);
+		files[nfiles].sec = files[nfiles].nsec = 0;
+		nfiles++;
+	}
+	closedir(d);
+
+	/* Hand the files over in one go to keep the lock cold; failures are
+	 * reported under it too. */
+	pthread_mutex_lock(&wk->mu);
+	if (failed)
+		wk->failed = 1;
+	if (nfiles > 0 &&
+	    grow(&wk->w->files, &wk->cap_files, wk->w->nfiles + nfiles - 1,
+	         sizeof(WalkEnt)) == 0) {
+		memcpy(wk->w->files + wk->w->nfiles, files, nfiles * sizeof(WalkEnt));
+		wk->w->nfiles += nfiles;
+		nfiles = 0;
+	} else if (nfiles > 0) {
+		wk->failed = 1;
+	}
+	pthread_mutex_unlock(&wk->mu);
+	for (i = 0; i < nfiles; i++)
+		free(files[i].path);
+	free(files);
+}
+
+void *
+walker(void *arg)
+{
+	Walker *wk = arg;
+	Pending p;
+
+	pthread_mutex_lock(&wk->mu);
+	for (;;) {
+		while (wk->nstack == 0 && wk->busy > 0)
+			pthread_cond_wait(&wk->cv, &wk->mu);
+		if (wk->nstack == 0)
+			break; /* Nothing queued and nobody left to queue more. */
+		p = wk->stack[--wk->nstack];
+		wk->busy++;
+		pthread_mutex_unlock(&wk->mu);
+
+		read_dir(wk, p.rel, p.up);
+
+		pthread_mutex_lock(&wk->mu);
+		wk->busy--;
+		if (wk->busy == 0 && wk->nstack == 0)
+			pthread_cond_broadcast(&wk->cv);
+	}
+	pthread_mutex_unlock(&wk->mu);
+	return NULL;
+}
+
+int
+walk_tree(const char *root, Walk *w)
+{
+	pthread_t threads[MAX_WALKERS];
+	Walker wk = {0};
+	DirId *id;
+	long ncpu;
+	size_t nthreads, started, i;
+	char *rel;
+
+	memset(w, 0, sizeof(*w));
+	COST_ADD(opens, 1);
+	if ((wk.root_fd = open(root, O_RDONLY|O_DIRECTORY)) == -1)
+		return (errno == ENOENT) ? 0 : -1;
+	if ((rel = strdup("")) == NULL) {
+		close(wk.root_fd);
+		return -1;
+	}
+	wk.w = w;
+	pthread_mutex_init(&wk.mu, NULL);
+	pthread_cond_init(&wk.cv, NULL);
+	push_dir(&wk, rel, NULL);
+
+	/* Directory reads mostly wait on the disk or the network. */
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	nthreads = (ncpu > 0) ? (size_t)ncpu * 2 : 4;
+	if (nthreads > MAX_WALKERS)
+		nthreads = MAX_WALKERS;
+	for (started = 0; started < nthreads; started++)
+		if (pthread_create(&threads[started], NULL, walker, &wk) != 0)
+			break;
+	if (started == 0)
+		walker(&wk);
+	for (i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+
+	close(wk.root_fd);
+	pthread_cond_destroy(&wk.cv);
+	pthread_mutex_destroy(&wk.mu);
+	free(wk.stack);
+	while ((id = wk.ids) != NULL) {
+		wk.ids = id->next;
+		free(id);
+	}
+	if (wk.failed) {
+		walk_free(w);
+		return -1;
+	}
+
+	qsort(w->files, w->nfiles, sizeof(WalkEnt), ent_cmp);
+	qsort(w->dirs, w->ndirs, sizeof(WalkEnt), ent_cmp);
+	return 0;
+}
+
+void
+walk_free(Walk *w)
+{
+	size_t i;
+
+	for (i = 0; i < w->nfiles; i++)
+		free(w->files[i].path);
+	for (i = 0; i < w->ndirs; i++)
+		free(w->dirs[i].path);
+	free(w->files);
+	free(w->dirs);
+	memset(w, 0, sizeof(*w));
+}
+
+const char *
+walk_parent(const char *root, const char *path, char *buf, size_t size)
+{
+	const char *end = strrchr(path, '/'), *start;
+	size_t len;
+
+	if (end == NULL) {
+		/* Last component of the root, trailing slashes aside. */
+		for (len = strlen(root); len > 1 && root[len - 1] == '/'; len--)
+			;
+		for (start = root + len; start > root && start[-1] != '/'; start--)
+			;
+		if (start == root + len)
+			start = root; /* Just "/". */
+		if ((size_t)(root + len - start) >= size)
+			return "";
+		memcpy(buf, start, root + len - start);
+		buf[root + len - start] = 0;
+		return buf;
+	}
+	for (start = end; start > path && start[-1] != '/'; start--)
+		;
+	if ((size_t)(end - start) >= size)
+		return "";
+	memcpy(buf, start, end - start);
+	buf[end - start] = 0;
+	return buf;
+}
@@ -0,0 +1,35 @@
+/* SPDX-License-Identifier: MIT
+ * Copyright (c) 2026 Ivan Kovmir */
+#ifndef WALK_H
+#define WALK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef struct {
+	char *path;        /* Relative to the root; "" is the root itself. */
+	const char *name;  /* Last component of path. */
+	int64_t sec, nsec; /* Modification time; directories only. */
+} WalkEnt;
+
+typedef struct {
+	WalkEnt *files;    /* Regular files, in fts(3) preorder. */
+	size_t nfiles;
+	WalkEnt *dirs;     /* Directories, in the same order; root first. */
+	size_t ndirs;
+} Walk;
+
+/* Collect every file and directory under root, following symlinks, using
+ * parallel workers. A missing root yields an empty walk. */
+int walk_tree(const char *root, Walk *w);
+/* Release the walk. */
+void walk_free(Walk *w);
+/* Name of the directory holding the file at path, relative to root. Files
+ * at the top are in the root, named by its last component. */
+const char *walk_parent(const char *root, const char *path, char *buf,
+                        size_t size);
+/* Compare relative paths component by component, which sorts a tree in
+ * preorder with siblings in strcmp() order. */
+int walk_pathcmp(const char *a, const char *b);
+
+#endif /* WALK_H */